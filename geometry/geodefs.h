@@ -9,4 +9,20 @@ typedef float fp_t;
 #define M_PI 3.14159265358979323846
 #endif
 
+/* header functions, -ansi has no inline keyword. */
+#ifdef __GNUC__
+#define GEO_INLINE static __inline__
+#else
+#define GEO_INLINE static
+#endif
+
+/* lanes processed together by the batch (SoA) functions. */
+#if defined(__AVX2__)
+#define GEO_LANES 8
+#elif defined(__SSE__)
+#define GEO_LANES 4
+#else
+#define GEO_LANES 1
+#endif
+
 #endif /* GEODEFS_H */
@@ -0,0 +1,31 @@
+#ifndef GEOSIMD_H
+#define GEOSIMD_H
+
+/* vector registers for the batch functions, GEO_LANES floats wide. internal
+ * to geometry/, the scalar tails use the GEO_INLINE functions. */
+
+#include "geodefs.h"
+
+#if GEO_LANES == 8
+#include <immintrin.h>
+typedef __m256 geovec_t;
+#define geo_load(_p)      _mm256_loadu_ps(_p)
+#define geo_store(_p, _a) _mm256_storeu_ps(_p, _a)
+#define geo_add(_a, _b)   _mm256_add_ps(_a, _b)
+#define geo_sub(_a, _b)   _mm256_sub_ps(_a, _b)
+#define geo_mul(_a, _b)   _mm256_mul_ps(_a, _b)
+#define geo_div(_a, _b)   _mm256_div_ps(_a, _b)
+#define geo_sqrt(_a)      _mm256_sqrt_ps(_a)
+#elif GEO_LANES == 4
+#include <xmmintrin.h>
+typedef __m128 geovec_t;
+#define geo_load(_p)      _mm_loadu_ps(_p)
+#define geo_store(_p, _a) _mm_storeu_ps(_p, _a)
+#define geo_add(_a, _b)   _mm_add_ps(_a, _b)
+#define geo_sub(_a, _b)   _mm_sub_ps(_a, _b)
+#define geo_mul(_a, _b)   _mm_mul_ps(_a, _b)
+#define geo_div(_a, _b)   _mm_div_ps(_a, _b)
+#define geo_sqrt(_a)      _mm_sqrt_ps(_a)
+#endif
+
+#endif /* GEOSIMD_H */
@@ -1,25 +1,7 @@
 #include <math.h>
 #include "v3.h"
 #include "quat.h"
-
-quat_t *quat_fill(quat_t *r, fp_t x, fp_t y, fp_t z, fp_t w) {
-	r->w = w;
-	r->x = x;
-	r->y = y;
-	r->z = z;
-	return r;
-}
-
-quat_t *quat_make(quat_t *r, fp_t x, fp_t y, fp_t z) {
-	return quat_fill(r, x, y, z, 1);
-}
-
-void quat_calcw(quat_t *r) {
-	fp_t t = 1.0 - (r->x*r->x) - (r->y*r->y) - (r->z*r->z);
-
-	if (t<0) r->w = 0;
-	else r->w = -sqrt(t);
-}
+#include "geosimd.h"
 
 quat_t *quat_makev(quat_t *r, fp_t angle, const v3_t *u) {
 	v3_t v;
@@ -34,51 +16,101 @@ quat_t *quat_makev(quat_t *r, fp_t angle, const v3_t *u) {
 	return r;
 }
 
-fp_t quat_normal(quat_t *q) {
-	return sqrt(q->x*q->x + q->y*q->y + q->z*q->z + q->w*q->w);
-}
+/* -------------------------------------------------------------------------- */
+/* batch versions, same operations in the same order as the scalar ones.      */
+/* -------------------------------------------------------------------------- */
 
-quat_t *quat_normalize(quat_t *r, const quat_t *q) {
-	fp_t mag = sqrt(q->x*q->x + q->y*q->y + q->z*q->z + q->w*q->w);
+#define QUAT_GET(_q, _s, _i) \
+	quat_fill(_q, (_s)->x[_i], (_s)->y[_i], (_s)->z[_i], (_s)->w[_i])
+#define QUAT_PUT(_s, _i, _q) ((_s)->x[_i] = (_q)->x, (_s)->y[_i] = (_q)->y, \
+		(_s)->z[_i] = (_q)->z, (_s)->w[_i] = (_q)->w)
 
-	r->w = q->w / mag;
-	r->x = q->x / mag;
-	r->y = q->y / mag;
-	r->z = q->z / mag;
-	return r;
-}
+void quat_normalize_n(const quatsoa_t *r, const quatsoa_t *q, int n) {
+	int i=0;
 
-quat_t *quat_mulq(quat_t *out,  const quat_t *qa, const quat_t *qb) {
-	quat_t tmp;
-	tmp.w = qa->w*qb->w - qa->x*qb->x - qa->y*qb->y - qa->z*qb->z;
-	tmp.x = qa->x*qb->w + qa->w*qb->x + qa->y*qb->z - qa->z*qb->y;
-	tmp.y = qa->y*qb->w + qa->w*qb->y + qa->z*qb->x - qa->x*qb->z;
-	tmp.z = qa->z*qb->w + qa->w*qb->z + qa->x*qb->y - qa->y*qb->x;
-	*out = tmp;
-	return out;
-}
+#if GEO_LANES > 1
+	for (; i + GEO_LANES <= n; i += GEO_LANES) {
+		geovec_t x = geo_load(q->x + i);
+		geovec_t y = geo_load(q->y + i);
+		geovec_t z = geo_load(q->z + i);
+		geovec_t w = geo_load(q->w + i);
+		geovec_t mag = geo_sqrt(geo_add(geo_add(geo_add(geo_mul(x, x),
+							geo_mul(y, y)), geo_mul(z, z)), geo_mul(w, w)));
 
-quat_t *quat_mulv(quat_t *out, const quat_t *q, const v3_t *v) {
-	quat_t tmp;
-	tmp.w = - q->x*v->x - q->y*v->y - q->z*v->z;
-	tmp.x =   q->w*v->x + q->y*v->z - q->z*v->y;
-	tmp.y =   q->w*v->y + q->z*v->x - q->x*v->z;
-	tmp.z =   q->w*v->z + q->x*v->y - q->y*v->x;
-	*out = tmp;
-	return out;
+		geo_store(r->w + i, geo_div(w, mag));
+		geo_store(r->x + i, geo_div(x, mag));
+		geo_store(r->y + i, geo_div(y, mag));
+		geo_store(r->z + i, geo_div(z, mag));
+	}
+#endif
+	for (; i<n; i++) {
+		quat_t t;
+		quat_normalize(&t, QUAT_GET(&t, q, i));
+		QUAT_PUT(r, i, &t);
+	}
 }
 
-quat_t *quat_conjugate(quat_t *r, const quat_t *q) {
-	r->w = q->w;
-	r->x =-q->x;
-	r->y =-q->y;
-	r->z =-q->z;
-	return r;
+void quat_mulq_n(const quatsoa_t *out,
+		const quatsoa_t *qa, const quatsoa_t *qb, int n) {
+	int i=0;
+
+#if GEO_LANES > 1
+	for (; i + GEO_LANES <= n; i += GEO_LANES) {
+		geovec_t ax = geo_load(qa->x + i), bx = geo_load(qb->x + i);
+		geovec_t ay = geo_load(qa->y + i), by = geo_load(qb->y + i);
+		geovec_t az = geo_load(qa->z + i), bz = geo_load(qb->z + i);
+		geovec_t aw = geo_load(qa->w + i), bw = geo_load(qb->w + i);
+
+		geo_store(out->w + i, geo_sub(geo_sub(geo_sub(geo_mul(aw, bw),
+							geo_mul(ax, bx)), geo_mul(ay, by)), geo_mul(az, bz)));
+		geo_store(out->x + i, geo_sub(geo_add(geo_add(geo_mul(ax, bw),
+							geo_mul(aw, bx)), geo_mul(ay, bz)), geo_mul(az, by)));
+		geo_store(out->y + i, geo_sub(geo_add(geo_add(geo_mul(ay, bw),
+							geo_mul(aw, by)), geo_mul(az, bx)), geo_mul(ax, bz)));
+		geo_store(out->z + i, geo_sub(geo_add(geo_add(geo_mul(az, bw),
+							geo_mul(aw, bz)), geo_mul(ax, by)), geo_mul(ay, bx)));
+	}
+#endif
+	for (; i<n; i++) {
+		quat_t a, b;
+		quat_mulq(&a, QUAT_GET(&a, qa, i), QUAT_GET(&b, qb, i));
+		QUAT_PUT(out, i, &a);
+	}
 }
 
-v3_t *quat_rotatep(v3_t *out, const quat_t *q, const v3_t *in) {
-	quat_t tmp, inv;
+void quat_rotatep_n(const v3soa_t *out,
+		const quatsoa_t *q, const v3soa_t *in, int n) {
+	int i=0;
+
+#if GEO_LANES > 1
+	for (; i + GEO_LANES <= n; i += GEO_LANES) {
+		geovec_t qx = geo_load(q->x + i), vx = geo_load(in->x + i);
+		geovec_t qy = geo_load(q->y + i), vy = geo_load(in->y + i);
+		geovec_t qz = geo_load(q->z + i), vz = geo_load(in->z + i);
+		geovec_t qw = geo_load(q->w + i);
+		geovec_t tx = geo_sub(geo_mul(qy, vz), geo_mul(qz, vy));
+		geovec_t ty = geo_sub(geo_mul(qz, vx), geo_mul(qx, vz));
+		geovec_t tz = geo_sub(geo_mul(qx, vy), geo_mul(qy, vx));
+
+		tx = geo_add(tx, tx);
+		ty = geo_add(ty, ty);
+		tz = geo_add(tz, tz);
+		geo_store(out->x + i, geo_add(geo_add(vx, geo_mul(qw, tx)),
+					geo_sub(geo_mul(qy, tz), geo_mul(qz, ty))));
+		geo_store(out->y + i, geo_add(geo_add(vy, geo_mul(qw, ty)),
+					geo_sub(geo_mul(qz, tx), geo_mul(qx, tz))));
+		geo_store(out->z + i, geo_add(geo_add(vz, geo_mul(qw, tz)),
+					geo_sub(geo_mul(qx, ty), geo_mul(qy, tx))));
+	}
+#endif
+	for (; i<n; i++) {
+		quat_t r;
+		v3_t v;
 
-	quat_mulq(&tmp, quat_mulv(&tmp, q, in), quat_conjugate(&inv, q));
-	return v3_make(out, tmp.x, tmp.y, tmp.z);
+		QUAT_GET(&r, q, i);
+		quat_rotatep(&v, &r, v3_make(&v, in->x[i], in->y[i], in->z[i]));
+		out->x[i] = v.x;
+		out->y[i] = v.y;
+		out->z[i] = v.z;
+	}
 }
@@ -9,23 +9,128 @@ typedef struct {
 	fp_t x, y, z, w;
 } quat_t;
 
-quat_t *quat_make(quat_t *q, fp_t x, fp_t y, fp_t z);
-quat_t *quat_fill(quat_t *r, fp_t x, fp_t y, fp_t z, fp_t w);
-quat_t *quat_makev(quat_t *q, fp_t angle, const v3_t *u);
-void    quat_calcw(quat_t *r);
+/* structure of arrays, for the batch functions. */
+typedef struct {
+	fp_t *x, *y, *z, *w;
+} quatsoa_t;
 
 #define quat_getx(_u) ((_u)->x)
 #define quat_gety(_u) ((_u)->y)
 #define quat_getz(_u) ((_u)->z)
 #define quat_getw(_u) ((_u)->w)
 
-fp_t    quat_normal(quat_t *q);
-quat_t *quat_normalize(quat_t *r, const quat_t *q);
-quat_t *quat_add(quat_t *r, const quat_t *qa, const quat_t *qb);
-quat_t *quat_sub(quat_t *r, const quat_t *qa, const quat_t *qb);
-quat_t *quat_mulq(quat_t *out,  const quat_t *qa, const quat_t *qb);
-quat_t *quat_mulv(quat_t *out, const quat_t *q, const v3_t *v);
-quat_t *quat_conjugate(quat_t *r, const quat_t *q);
-v3_t   *quat_rotatep(v3_t *out, const quat_t *q, const v3_t *in);
+quat_t *quat_makev(quat_t *q, fp_t angle, const v3_t *u);
+
+GEO_INLINE quat_t *quat_fill(quat_t *r, fp_t x, fp_t y, fp_t z, fp_t w) {
+	r->w = w;
+	r->x = x;
+	r->y = y;
+	r->z = z;
+	return r;
+}
+
+GEO_INLINE quat_t *quat_make(quat_t *r, fp_t x, fp_t y, fp_t z) {
+	return quat_fill(r, x, y, z, 1);
+}
+
+GEO_INLINE void quat_calcw(quat_t *r) {
+	fp_t t = 1.0 - (r->x*r->x) - (r->y*r->y) - (r->z*r->z);
+
+	if (t<0) r->w = 0;
+	else r->w = -sqrt(t);
+}
+
+GEO_INLINE fp_t quat_normal(const quat_t *q) {
+	return sqrt(q->x*q->x + q->y*q->y + q->z*q->z + q->w*q->w);
+}
+
+GEO_INLINE quat_t *quat_normalize(quat_t *r, const quat_t *q) {
+	fp_t mag = sqrt(q->x*q->x + q->y*q->y + q->z*q->z + q->w*q->w);
+
+	r->w = q->w / mag;
+	r->x = q->x / mag;
+	r->y = q->y / mag;
+	r->z = q->z / mag;
+	return r;
+}
+
+GEO_INLINE quat_t *quat_add(quat_t *r, const quat_t *qa, const quat_t *qb) {
+	r->w = qa->w + qb->w;
+	r->x = qa->x + qb->x;
+	r->y = qa->y + qb->y;
+	r->z = qa->z + qb->z;
+	return r;
+}
+
+GEO_INLINE quat_t *quat_sub(quat_t *r, const quat_t *qa, const quat_t *qb) {
+	r->w = qa->w - qb->w;
+	r->x = qa->x - qb->x;
+	r->y = qa->y - qb->y;
+	r->z = qa->z - qb->z;
+	return r;
+}
+
+GEO_INLINE quat_t *quat_mulq(quat_t *out, const quat_t *qa, const quat_t *qb) {
+	quat_t tmp;
+	tmp.w = qa->w*qb->w - qa->x*qb->x - qa->y*qb->y - qa->z*qb->z;
+	tmp.x = qa->x*qb->w + qa->w*qb->x + qa->y*qb->z - qa->z*qb->y;
+	tmp.y = qa->y*qb->w + qa->w*qb->y + qa->z*qb->x - qa->x*qb->z;
+	tmp.z = qa->z*qb->w + qa->w*qb->z + qa->x*qb->y - qa->y*qb->x;
+	*out = tmp;
+	return out;
+}
+
+GEO_INLINE quat_t *quat_mulv(quat_t *out, const quat_t *q, const v3_t *v) {
+	quat_t tmp;
+	tmp.w = - q->x*v->x - q->y*v->y - q->z*v->z;
+	tmp.x =   q->w*v->x + q->y*v->z - q->z*v->y;
+	tmp.y =   q->w*v->y + q->z*v->x - q->x*v->z;
+	tmp.z =   q->w*v->z + q->x*v->y - q->y*v->x;
+	*out = tmp;
+	return out;
+}
+
+GEO_INLINE quat_t *quat_conjugate(quat_t *r, const quat_t *q) {
+	r->w = q->w;
+	r->x =-q->x;
+	r->y =-q->y;
+	r->z =-q->z;
+	return r;
+}
+
+/* q*v*q^-1 for unit q, as v + w*t + q.xyz x t with t = 2(q.xyz x v).
+ * the batch version does the very same float operations. */
+GEO_INLINE v3_t *quat_rotatep(v3_t *out, const quat_t *q, const v3_t *in) {
+	fp_t tx = q->y*in->z - q->z*in->y;
+	fp_t ty = q->z*in->x - q->x*in->z;
+	fp_t tz = q->x*in->y - q->y*in->x;
+
+	tx = tx + tx;
+	ty = ty + ty;
+	tz = tz + tz;
+	return v3_make(out,
+			in->x + q->w*tx + (q->y*tz - q->z*ty),
+			in->y + q->w*ty + (q->z*tx - q->x*tz),
+			in->z + q->w*tz + (q->x*ty - q->y*tx));
+}
+
+/* rotation matrix of unit q, m[row][col], m times v rotates v as
+ * quat_rotatep does. */
+GEO_INLINE void quat_mat3(fp_t m[3][3], const quat_t *q) {
+	fp_t xx = q->x*q->x, yy = q->y*q->y, zz = q->z*q->z;
+	fp_t xy = q->x*q->y, xz = q->x*q->z, yz = q->y*q->z;
+	fp_t wx = q->w*q->x, wy = q->w*q->y, wz = q->w*q->z;
+
+	m[0][0] = 1 - 2*(yy + zz); m[0][1] = 2*(xy - wz); m[0][2] = 2*(xz + wy);
+	m[1][0] = 2*(xy + wz); m[1][1] = 1 - 2*(xx + zz); m[1][2] = 2*(yz - wx);
+	m[2][0] = 2*(xz - wy); m[2][1] = 2*(yz + wx); m[2][2] = 1 - 2*(xx + yy);
+}
+
+/* batch versions, outputs may alias inputs. */
+void quat_normalize_n(const quatsoa_t *r, const quatsoa_t *q, int n);
+void quat_mulq_n(const quatsoa_t *out,
+		const quatsoa_t *qa, const quatsoa_t *qb, int n);
+void quat_rotatep_n(const v3soa_t *out,
+		const quatsoa_t *q, const v3soa_t *in, int n);
 
 #endif /* QUAT_H */
@@ -0,0 +1,61 @@
+#include "soa.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* dst[c][i] = rows[i][at+c], four records at a time through 4x4 transposes.
+ * the last block of components overlaps the one before it rather than
+ * reading past the record. */
+void soa_gather_n(fp_t *const *dst, const fp_t *const *rows, int at,
+		int comps, int n) {
+	int i=0, c;
+
+#ifdef __SSE__
+	for (; i + 4 <= n; i += 4) {
+		for (c=0; c<comps; c+=4) {
+			int k = c + 4 <= comps ? c : comps - 4;
+			__m128 r0 = _mm_loadu_ps(rows[i] + at + k);
+			__m128 r1 = _mm_loadu_ps(rows[i+1] + at + k);
+			__m128 r2 = _mm_loadu_ps(rows[i+2] + at + k);
+			__m128 r3 = _mm_loadu_ps(rows[i+3] + at + k);
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(dst[k] + i, r0);
+			_mm_storeu_ps(dst[k+1] + i, r1);
+			_mm_storeu_ps(dst[k+2] + i, r2);
+			_mm_storeu_ps(dst[k+3] + i, r3);
+		}
+	}
+#endif
+	for (; i<n; i++)
+		for (c=0; c<comps; c++)
+			dst[c][i] = rows[i][at + c];
+}
+
+/* rows[i][at+c] = src[c][i], the inverse of soa_gather_n. */
+void soa_scatter_n(fp_t *const *rows, int at, const fp_t *const *src,
+		int comps, int n) {
+	int i=0, c;
+
+#ifdef __SSE__
+	for (; i + 4 <= n; i += 4) {
+		for (c=0; c<comps; c+=4) {
+			int k = c + 4 <= comps ? c : comps - 4;
+			__m128 r0 = _mm_loadu_ps(src[k] + i);
+			__m128 r1 = _mm_loadu_ps(src[k+1] + i);
+			__m128 r2 = _mm_loadu_ps(src[k+2] + i);
+			__m128 r3 = _mm_loadu_ps(src[k+3] + i);
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(rows[i] + at + k, r0);
+			_mm_storeu_ps(rows[i+1] + at + k, r1);
+			_mm_storeu_ps(rows[i+2] + at + k, r2);
+			_mm_storeu_ps(rows[i+3] + at + k, r3);
+		}
+	}
+#endif
+	for (; i<n; i++)
+		for (c=0; c<comps; c++)
+			rows[i][at + c] = src[c][i];
+}
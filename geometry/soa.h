@@ -0,0 +1,15 @@
+#ifndef SOA_H
+#define SOA_H
+
+#include "geodefs.h"
+
+/* moves records of comps floats (4 at least) in and out of the component
+ * arrays the batch functions take. record i starts at row i plus at, so the
+ * rows may sit in separate allocations and one set of row pointers serves
+ * every column of records. */
+void soa_gather_n(fp_t *const *dst, const fp_t *const *rows, int at,
+		int comps, int n);
+void soa_scatter_n(fp_t *const *rows, int at, const fp_t *const *src,
+		int comps, int n);
+
+#endif /* SOA_H */
@@ -8,24 +8,90 @@ typedef struct {
 	fp_t x, y, z;
 } v3_t;
 
-v3_t *v3_make(v3_t *u, fp_t x, fp_t y, fp_t z);
-v3_t *v3_zero(v3_t *u);
+/* structure of arrays, for the batch functions. */
+typedef struct {
+	fp_t *x, *y, *z;
+} v3soa_t;
 
 #define v3_getx(_u) ((_u)->x)
 #define v3_gety(_u) ((_u)->y)
 #define v3_getz(_u) ((_u)->z)
 
-v3_t *v3_minus(v3_t *o, const v3_t *u);
-v3_t *v3_normalize(v3_t *r, const v3_t *u);
-v3_t *v3_scale(v3_t *o, const v3_t *u, fp_t k);
+GEO_INLINE v3_t *v3_make(v3_t *u, fp_t x, fp_t y, fp_t z) {
+	u->x = x;
+	u->y = y;
+	u->z = z;
+	return u;
+}
+
+GEO_INLINE v3_t *v3_zero(v3_t *u) {
+	return v3_make(u, 0, 0, 0);
+}
+
+GEO_INLINE fp_t v3_dot(const v3_t *u, const v3_t *v) {
+	return u->x * v->x + u->y * v->y + u->z * v->z;
+}
+
+GEO_INLINE fp_t v3_norm(const v3_t *u) {
+	return sqrt(v3_dot(u, u));
+}
+
+GEO_INLINE v3_t *v3_minus(v3_t *r, const v3_t *u) {
+	r->x = - u->x;
+	r->y = - u->y;
+	r->z = - u->z;
+	return r;
+}
+
+GEO_INLINE v3_t *v3_normalize(v3_t *r, const v3_t *u) {
+	fp_t normal = v3_norm(u);
+
+	r->x = u->x / normal;
+	r->y = u->y / normal;
+	r->z = u->z / normal;
+	return r;
+}
+
+GEO_INLINE v3_t *v3_scale(v3_t *r, const v3_t *u, fp_t k) {
+	r->x = u->x / k;
+	r->y = u->y / k;
+	r->z = u->z / k;
+	return r;
+}
+
+GEO_INLINE v3_t *v3_add(v3_t *r, const v3_t *u, const v3_t *v) {
+	r->x = u->x + v->x;
+	r->y = u->y + v->y;
+	r->z = u->z + v->z;
+	return r;
+}
+
+GEO_INLINE v3_t *v3_sub(v3_t *r, const v3_t *u, const v3_t *v) {
+	r->x = u->x - v->x;
+	r->y = u->y - v->y;
+	r->z = u->z - v->z;
+	return r;
+}
+
+GEO_INLINE v3_t *v3_cross(v3_t *r, const v3_t *u, const v3_t *v) {
+	v3_t tmp;
+
+	tmp.x = u->y*v->z - u->z*v->y;
+	tmp.y = u->z*v->x - u->x*v->z;
+	tmp.z = u->x*v->y - u->y*v->x;
+	*r = tmp;
+	return r;
+}
+
+/* vector projection of u on v, (u.v/v.v)v, zero when v is. */
+GEO_INLINE v3_t *v3_project(v3_t *r, const v3_t *u, const v3_t *v) {
+	fp_t vv = v3_dot(v, v), k = vv > 0 ? v3_dot(u, v) / vv : 0;
 
-v3_t *v3_add(v3_t *o, const v3_t *u, const v3_t *v);
-v3_t *v3_sub(v3_t *o, const v3_t *u, const v3_t *v);
-v3_t *v3_cross(v3_t *r, const v3_t *u, const v3_t *v);
-v3_t *v3_project(v3_t *r, const v3_t *u, const v3_t *v);
+	return v3_make(r, v->x * k, v->y * k, v->z * k);
+}
 
-fp_t  v3_dot(const v3_t *u, const v3_t *v);
-fp_t  v3_norm(const v3_t *u);
-fp_t  v3_sproject(v3_t *r, const v3_t *u, const v3_t *v);
+/* batch versions, r may alias u. */
+void  v3_normalize_n(const v3soa_t *r, const v3soa_t *u, int n);
+void  v3_add_n(const v3soa_t *r, const v3soa_t *u, const v3soa_t *v, int n);
 
 #endif /* V3_H */
@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 #include "md5model.h"
 #include "md5anim.h"
+#include "md5async.h"
 #include <GL/glew.h>
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_opengl.h>
@@ -14,11 +16,40 @@ struct game {
 };
 #define FPS 60.0
 
+/* one posed and skinned frame, meshes as packed F32 positions. */
+struct slot {
+	int frame;
+	struct md5joint *skel;
+	float **verts;
+};
+
+/* the worker fills slot[back] with frame N+1 while slot[!back] (frame N)
+ * is drawn. kicked counts frames handed to the worker, done the ones it
+ * finished; the fence is done == kicked. */
+struct pipeline {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t work, fence;
+	int kicked, done, quit, back;
+	double skin_time;              /* worker seconds for the last frame. */
+
+	struct md5bind bind;
+	struct md5vfmt fmt;
+	struct slot slot[2];
+};
+
+/* frame times, reported and reset every STATS_FRAMES frames. */
+#define STATS_FRAMES 240
+struct stats {
+	int frames;
+	double last, min, max, sum;
+	double wait, skin;
+};
+
 static struct game G;
 static struct md5model _model;
 static struct md5anim _anim;
-
-void md5mkmesh(struct md5mesh *mesh, struct md5joint *skel);
+static struct pipeline P;
 
 static void opengl_dump(void)
 {
@@ -36,16 +67,26 @@ static void opengl_dump(void)
 
 void game_init(unsigned int w, unsigned int h)
 {
-	assert(glewInit());
-	assert(al_init());
-	assert((G.q = al_create_event_queue()));
-	assert(G.tick = al_create_timer(1.0 / FPS));
-	assert(al_install_mouse());
-	assert(al_install_keyboard());
+	int ok;
+
+	ok = al_init();
+	assert(ok);
+	G.q = al_create_event_queue();
+	assert(G.q);
+	G.tick = al_create_timer(1.0 / FPS);
+	assert(G.tick);
+	ok = al_install_mouse();
+	assert(ok);
+	ok = al_install_keyboard();
+	assert(ok);
 
 	al_set_new_display_flags(ALLEGRO_OPENGL);
 
-	assert(G.display = al_create_display(w, h));
+	G.display = al_create_display(w, h);
+	assert(G.display);
+	/* needs the display's context current. */
+	ok = glewInit() == GLEW_OK;
+	assert(ok);
 
 	glViewport(0, 0, w, h);
 	glMatrixMode(GL_PROJECTION);
@@ -94,10 +135,157 @@ void drawskel(const struct md5joint *skeleton,
 	glEnd();
 }
 
+/* -------------------------------------------------------------------------- */
+
+static void *pipeline_worker(void *udata)
+{
+	struct pipeline *p = udata;
+	struct slot *slot;
+	int m;
+	double start;
+
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (!p->quit && p->done == p->kicked)
+			pthread_cond_wait(&p->work, &p->lock);
+		if (p->quit) break;
+		slot = &p->slot[p->back];
+		pthread_mutex_unlock(&p->lock);
+
+		start = al_get_time();
+		md5anim_pose(&p->bind, slot->frame, slot->skel);
+		for (m=0; m<_model.num.meshes; m++)
+			md5model_skin(&_model.meshes[m], slot->skel, &p->fmt,
+					slot->verts[m]);
+
+		pthread_mutex_lock(&p->lock);
+		p->skin_time = al_get_time() - start;
+		p->done++;
+		pthread_cond_signal(&p->fence);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+static void pipeline_init(struct pipeline *p)
+{
+	int i, m, err;
+
+	p->kicked = p->done = p->quit = p->back = 0;
+	p->skin_time = 0;
+	md5anim_bind(&p->bind, &_anim, &_model);
+	p->fmt.type = MD5_VFMT_F32;
+	p->fmt.st = 0;
+	p->fmt.stride = 0;
+	for (i=0; i<2; i++) {
+		struct slot *slot = &p->slot[i];
+
+		slot->frame = 0;
+		slot->skel = malloc(sizeof(struct md5joint)
+				* MD5_MAX(_model.num.joints, 1));
+		assert(slot->skel);
+		slot->verts = malloc(sizeof(float *) * MD5_MAX(_model.num.meshes, 1));
+		assert(slot->verts);
+		for (m=0; m<_model.num.meshes; m++) {
+			slot->verts[m] = malloc(md5vfmt_size(&p->fmt)
+					* MD5_MAX(_model.meshes[m].num.verts, 1));
+			assert(slot->verts[m]);
+		}
+	}
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->fence, NULL);
+	err = pthread_create(&p->thread, NULL, pipeline_worker, p);
+	assert(!err);
+}
+
+static void pipeline_end(struct pipeline *p)
+{
+	int i, m;
+
+	pthread_mutex_lock(&p->lock);
+	p->quit = 1;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->lock);
+	pthread_join(p->thread, NULL);
+
+	for (i=0; i<2; i++) {
+		for (m=0; m<_model.num.meshes; m++)
+			free(p->slot[i].verts[m]);
+		free(p->slot[i].verts);
+		free(p->slot[i].skel);
+	}
+	md5bind_end(&p->bind);
+	pthread_cond_destroy(&p->work);
+	pthread_cond_destroy(&p->fence);
+	pthread_mutex_destroy(&p->lock);
+}
+
+/* hands frame to the worker, into the back slot. */
+static void pipeline_kick(struct pipeline *p, int frame)
+{
+	pthread_mutex_lock(&p->lock);
+	p->slot[p->back].frame = frame;
+	p->kicked++;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* waits for the kicked frame and makes it the front slot, returns it. */
+static struct slot *pipeline_fence(struct pipeline *p, double *skin)
+{
+	struct slot *front;
+
+	pthread_mutex_lock(&p->lock);
+	while (p->done != p->kicked)
+		pthread_cond_wait(&p->fence, &p->lock);
+	front = &p->slot[p->back];
+	p->back = !p->back;
+	*skin = p->skin_time;
+	pthread_mutex_unlock(&p->lock);
+	return front;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void stats_reset(struct stats *st)
+{
+	st->frames = 0;
+	st->min = 1e9;
+	st->max = st->sum = st->wait = st->skin = 0;
+}
+
+static void stats_frame(struct stats *st, double now, double wait,
+		double skin)
+{
+	double dt = now - st->last;
+
+	st->last = now;
+	st->frames++;
+	st->min = dt < st->min ? dt : st->min;
+	st->max = dt > st->max ? dt : st->max;
+	st->sum += dt;
+	st->wait += wait;
+	st->skin += skin;
+	if (st->frames < STATS_FRAMES) return;
+
+	printf("frame ms: avg %.2f min %.2f max %.2f, "
+			"fence wait %.3f, skin %.3f (worker)\n",
+			1e3 * st->sum / st->frames, 1e3 * st->min, 1e3 * st->max,
+			1e3 * st->wait / st->frames, 1e3 * st->skin / st->frames);
+	stats_reset(st);
+}
+
 void game_loop(void)
 {
-	int i, j;
-	uint8_t isdone=0, redraw=1, frame=0;
+	int i, j, m;
+	uint8_t isdone=0, redraw=1;
+	int frame=0;
+	struct stats st;
+
+	stats_reset(&st);
+	st.last = al_get_time();
+	pipeline_kick(&P, frame);
 
 	while(!isdone) {
 		ALLEGRO_EVENT ev;
@@ -109,29 +297,39 @@ void game_loop(void)
 		if(ev.type==ALLEGRO_EVENT_TIMER)
 			redraw = 1;
 		if (redraw){
-			glRotatef(0.2, 0, 0, 1);
-			glClear(GL_COLOR_BUFFER_BIT);
+			struct slot *front;
+			double wait = al_get_time(), skin;
 
+			/* frame N is ready, start N+1 before submitting N. */
+			front = pipeline_fence(&P, &skin);
+			wait = al_get_time() - wait;
 			if (++frame >= _anim.num.frames) frame=0;
-			printf("frame %d of %d\n", frame, _anim.num.frames);
+			pipeline_kick(&P, frame);
+
+			glRotatef(0.2, 0, 0, 1);
+			glClear(GL_COLOR_BUFFER_BIT);
 
-			drawskel(_anim.joints[frame], _model.jinfo, _model.num.joints);
-			md5mkmesh(&_model.meshes[0], _anim.joints[frame]);
+			drawskel(front->skel, _model.jinfo, _model.num.joints);
 			glColor3f (1.0f, 1.0f, 1.0f);
 
-			glBegin(GL_LINE_STRIP);
-			for(i=0; i<_model.meshes[0].num.tris; i++) {
-				for(j=0; j<3; j++) {
-					int tri = _model.meshes[0].tris[i].idx[j];
-					struct md5vertex *verts = &_model.meshes[0].verts[tri];
-					glVertex3fv((float *)&verts->pos);
-				}
+			for (m=0; m<_model.num.meshes; m++) {
+				const struct md5mesh *mesh = &_model.meshes[m];
+				const float *verts = front->verts[m];
+
+				glBegin(GL_LINE_STRIP);
+				for(i=0; i<mesh->num.tris; i++)
+					for(j=0; j<3; j++)
+						glVertex3fv(&verts[mesh->tris[i].idx[j] * 3]);
+				glEnd();
 			}
-			glEnd();
 
 			al_flip_display();
+			stats_frame(&st, al_get_time(), wait, skin);
+			redraw = 0;
 		}
 	}
+	/* the worker may still be filling the back slot. */
+	pipeline_fence(&P, &st.skin);
 }
 
 void game_end(void)
@@ -139,42 +337,45 @@ void game_end(void)
 	al_destroy_display(G.display);
 }
 
-void md5mkmesh(struct md5mesh *mesh, struct md5joint *skel)
-{
-	int j, k;
-
-	for (j=0; j<mesh->num.verts; j++) {
-		v3_make(&mesh->verts[j].pos, 0, 0, 0);
-		const struct md5vertex *vertex = &mesh->verts[j];
-		for (k=vertex->start; k<vertex->start + vertex->count; k++) {
-			v3_t wv;
-			const struct md5weight *weight = &mesh->weights[k];
-			const struct md5joint *joint = &skel[weight->joint];
-
-			quat_rotatep(&wv, &joint->ori, &weight->pos);
-			mesh->verts[j].pos.x += (joint->pos.x + wv.x) * weight->bias;
-			mesh->verts[j].pos.y += (joint->pos.y + wv.y) * weight->bias;
-			mesh->verts[j].pos.z += (joint->pos.z + wv.z) * weight->bias;
-		}
-	}
-}
-
 int main(int argc, char *argv[]) {
-	int err;
+	int err, merr, aerr;
+	struct md5async pool;
+	struct md5job mjob, ajob;
 
-	assert(argc > 1);
+	assert(argc > 2);
+	err = md5async_init(&pool, 2);
+	assert(!err);
 
-	err = md5model_load(argv[1], &_model);
-	if (err) printf("md5model: %d\n", err);
-
-	err = md5anim_load(argv[2], &_anim, &_model);
-	if (err) printf("md5anim: %d\n", err);
-	md5mkmesh(&_model.meshes[0], _model.base);
+	/* parse in the background while the display comes up. */
+	md5job_model(&mjob, argv[1], &_model);
+	md5job_anim(&ajob, argv[2], &_anim, &_model, &mjob);
+	md5async_submit(&pool, &mjob, MD5_PRIO_HIGH);
+	md5async_submit(&pool, &ajob, MD5_PRIO_NORMAL);
 
 	game_init(800, 600);
+
+	merr = md5async_wait(&pool, &mjob);
+	if (merr) printf("md5model: %d\n", merr);
+
+	aerr = md5async_wait(&pool, &ajob);
+	if (aerr) printf("md5anim: %d\n", aerr);
+	md5async_end(&pool);
+
+	/* nothing to play, a load that failed has already freed what it read
+	 * and a clip fails with its model. */
+	if (merr || aerr) {
+		if (!aerr) md5anim_end(&_anim);
+		if (!merr) md5model_end(&_model);
+		game_end();
+		return 1;
+	}
+
+	pipeline_init(&P);
 	game_loop();
+	pipeline_end(&P);
 	game_end();
 
 	md5anim_end(&_anim);
+	md5model_end(&_model);
 	return 0;
 }
@@ -1,8 +1,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "md5anim.h"
+#include "soa.h"
 
 #define MD5_FLAG_POS_X (1<<0)
 #define MD5_FLAG_POS_Y (1<<1)
@@ -11,12 +13,19 @@
 #define MD5_FLAG_ORI_Y (1<<4)
 #define MD5_FLAG_ORI_Z (1<<5)
 
+/* frames baked together, a joint's batch is 7 component arrays this long. */
+#define MD5_BAKE_BATCH (16)
+#define MD5_BAKE_SOA(_v, _q, _f) { \
+	(_v).x = (_f); (_v).y = (_f) + MD5_BAKE_BATCH; \
+	(_v).z = (_f) + 2*MD5_BAKE_BATCH; (_q).x = (_f) + 3*MD5_BAKE_BATCH; \
+	(_q).y = (_f) + 4*MD5_BAKE_BATCH; (_q).z = (_f) + 5*MD5_BAKE_BATCH; \
+	(_q).w = (_f) + 6*MD5_BAKE_BATCH; }
+
 /* -------------------------------------------------------------------------- */
 /* construction step, internal usage only for both structs.                   */
 /* -------------------------------------------------------------------------- */
 struct md5hierarchy {
-	char name[MD5_MAX_NAME_SZ];
-	int parent, flags, start_index;
+	int name, shared, parent, flags, start_index;
 };
 
 struct md5builder {
@@ -24,15 +33,22 @@ struct md5builder {
 	int frame_rate;
 
 	struct md5hierarchy *hierarchy;
+	struct md5names names;
 	struct md5bbox *bounds;
 	struct md5joint *base;
 	float **framedata;
 };
 
+/* a frame range baked by one thread. */
+struct md5bake_job {
+	struct md5anim *anim;
+	int first, count;
+};
+
 /* -------------------------------------------------------------------------- */
 
 static int
-md5parse_hierarchy(FILE *, struct md5hierarchy *, int);
+md5parse_hierarchy(FILE *, struct md5hierarchy *, struct md5names *, int);
 static int
 md5parse_bboxes(FILE *, struct md5bbox *, int);
 static int
@@ -40,7 +56,14 @@ md5parse_baseframe(FILE *, struct md5joint *, int);
 static int
 md5parse_frames(FILE *, float **, int, int);
 static void
-md5anim_build_skeleton(struct md5builder *, float *, struct md5joint *);
+md5anim_decode(struct md5builder *, float *, struct md5joint *);
+static void
+md5anim_bake_range(struct md5anim *, int, int);
+static void *
+md5anim_bake_thread(void *);
+static void
+md5joint_compose(struct md5joint *, const struct md5joint *,
+		const struct md5joint *);
 static int
 md5anim_validade_model(const struct md5builder *, const struct md5model *);
 
@@ -58,22 +81,34 @@ int md5anim_load(const char *fname,
 	FILE *in;
 
 	if (!(in = fopen(fname, "r"))) return -1;
-	if ((err=md5anim_read(in, anim, model))) return err;
+	err = md5anim_read(in, anim, model);
 	fclose(in);
 
-	return 0;
+	return err;
 }
 
-#define DONE(_err) { err=_err; goto done; }
 int md5anim_read(FILE *in,
 		struct md5anim *anim,
 		struct md5model *model) {
+	return md5anim_read_threads(in, anim, model, 1);
+}
+
+#define DONE(_err) { err=_err; goto done; }
+/* as md5anim_read, baking model space joints on up to threads threads. a
+ * file that fails part way frees what it had read, anim is left as
+ * md5anim_end leaves it. */
+int md5anim_read_threads(FILE *in,
+		struct md5anim *anim,
+		struct md5model *model,
+		int threads) {
 	int i=-1, err=-1;
 	char *cmdline=NULL;
 	size_t cmdlinesz;
 
 	struct md5builder build;
 	md5builder_init(&build);
+	memset(anim, 0, sizeof(*anim));
+	md5names_init(&anim->names);
 
 	if (!md5lex_checktk(in, "MD5Version")) DONE(1);
 	if (!md5lex_readint(in, &i) || i != 10) DONE(2);
@@ -83,52 +118,268 @@ int md5anim_read(FILE *in,
 	free(cmdline); cmdline=NULL; /* throw it away. */
 
 	if (!md5lex_checktk(in, "numFrames")) DONE(4);
-	if (!md5lex_readint(in, &build.num.frames)) DONE(5);
-	assert(build.bounds = malloc(sizeof(struct md5bbox) * build.num.frames));
-	assert(build.framedata = malloc(sizeof(float *) * build.num.frames));
+	if (!md5lex_readint(in, &build.num.frames) || build.num.frames < 0)
+		DONE(5);
+	build.bounds = malloc(sizeof(struct md5bbox) * MD5_MAX(build.num.frames, 1));
+	assert(build.bounds);
+	/* zeroed, md5builder_end frees them before they are all read. */
+	build.framedata = calloc(MD5_MAX(build.num.frames, 1), sizeof(float *));
+	assert(build.framedata);
 
 	if (!md5lex_checktk(in, "numJoints")) DONE(6);
-	if (!md5lex_readint(in, &build.num.joints)) DONE(7);
-	assert(build.hierarchy
-			= malloc(sizeof(struct md5hierarchy) * build.num.joints));
-	assert(build.base = malloc(sizeof(struct md5joint) * build.num.joints));
+	if (!md5lex_readint(in, &build.num.joints) || build.num.joints < 0)
+		DONE(7);
+	build.hierarchy = malloc(sizeof(struct md5hierarchy)
+			* MD5_MAX(build.num.joints, 1));
+	assert(build.hierarchy);
+	build.base = malloc(sizeof(struct md5joint) * MD5_MAX(build.num.joints, 1));
+	assert(build.base);
 
 	if (!md5lex_checktk(in, "frameRate")) DONE(8);
 	if (!md5lex_readint(in, &build.frame_rate)) DONE(9);
 
 	if (!md5lex_checktk(in, "numAnimatedComponents")) DONE(10);
-	if (!md5lex_readint(in, &build.num.animated_components)) DONE(11);
-	for (i=0; i<build.num.frames; i++)
-		assert(build.framedata[i]
-			= malloc(sizeof(float) * build.num.animated_components));
+	if (!md5lex_readint(in, &build.num.animated_components)
+			|| build.num.animated_components < 0)
+		DONE(11);
+	for (i=0; i<build.num.frames; i++) {
+		build.framedata[i]
+			= malloc(sizeof(float) * MD5_MAX(build.num.animated_components, 1));
+		assert(build.framedata[i]);
+	}
 
-	if (md5parse_hierarchy(in, build.hierarchy, build.num.joints)) DONE(12);
+	if (md5parse_hierarchy(in, build.hierarchy, &build.names,
+				build.num.joints)) DONE(12);
 	if (md5parse_bboxes(in, build.bounds, build.num.frames)) DONE(13);
 	if (md5parse_baseframe(in, build.base, build.num.joints)) DONE(14);
 	if (md5parse_frames(in, build.framedata, build.num.frames,
 				build.num.animated_components)) DONE(15);
 	if (!md5anim_validade_model(&build, model)) DONE(16);
 
-	assert(anim->joints = malloc(sizeof(struct md5joint *) * build.num.frames));
+	anim->joints = malloc(sizeof(struct md5joint *) * build.num.frames);
+	assert(anim->joints);
+	anim->local = malloc(sizeof(struct md5joint *) * build.num.frames);
+	assert(anim->local);
 	for (i=0; i<build.num.frames; i++) {
-		assert(anim->joints[i]
-				= malloc(sizeof(struct md5joint) * build.num.joints));
-		md5anim_build_skeleton(&build, build.framedata[i], anim->joints[i]);
+		anim->joints[i] = malloc(sizeof(struct md5joint) * build.num.joints);
+		assert(anim->joints[i]);
+		anim->local[i] = malloc(sizeof(struct md5joint) * build.num.joints);
+		assert(anim->local[i]);
+		md5anim_decode(&build, build.framedata[i], anim->local[i]);
+	}
+	anim->jinfo = malloc(sizeof(struct md5jinfo) * build.num.joints);
+	assert(anim->jinfo);
+	for (i=0; i<build.num.joints; i++) {
+		anim->jinfo[i].id = build.hierarchy[i].name;
+		anim->jinfo[i].name = md5names_str(&build.names, anim->jinfo[i].id);
+		anim->jinfo[i].shared = build.hierarchy[i].shared;
+		anim->jinfo[i].parent = build.hierarchy[i].parent;
 	}
+	anim->names = build.names; md5names_init(&build.names);
 	anim->bounds = build.bounds; build.bounds = NULL;
 	anim->num.joints = build.num.joints;
 	anim->num.frames = build.num.frames;
+	md5anim_bake(anim, threads);
+	err = 0;
 done:
 	md5builder_end(&build);
+	if (err) md5anim_end(anim);
 	return err;
 }
 
+/* frees everything anim holds. takes a clip md5anim_read refused or one
+ * already ended, and leaves it zeroed. */
 void md5anim_end(struct md5anim *anim) {
 	int i;
 
-	for (i=0; i<anim->num.frames; i++)
+	for (i=0; anim->joints && i<anim->num.frames; i++) {
 		free(anim->joints[i]);
+		free(anim->local[i]);
+	}
+	free(anim->joints);
+	free(anim->local);
 	free(anim->bounds);
+	free(anim->jinfo);
+	md5names_end(&anim->names);
+	memset(anim, 0, sizeof(*anim));
+	md5names_init(&anim->names);
+}
+
+/* rebuilds every frame's model space joints from its local ones, frame
+ * ranges split over up to threads threads. */
+void md5anim_bake(struct md5anim *anim, int threads) {
+	int t, err, per, frames = anim->num.frames;
+	struct md5bake_job *jobs;
+	pthread_t *tids;
+
+	/* not worth a thread below a batch of frames each. */
+	threads = MD5_MAX(MD5_MIN(threads, frames / MD5_BAKE_BATCH), 1);
+	if (threads == 1) {
+		md5anim_bake_range(anim, 0, frames);
+		return;
+	}
+
+	jobs = malloc(sizeof(struct md5bake_job) * threads);
+	assert(jobs);
+	tids = malloc(sizeof(pthread_t) * threads);
+	assert(tids);
+	/* whole batches per thread, the last one takes what is left. */
+	per = (frames / threads + MD5_BAKE_BATCH - 1)
+		/ MD5_BAKE_BATCH * MD5_BAKE_BATCH;
+	for (t=0; t<threads; t++) {
+		jobs[t].anim = anim;
+		jobs[t].first = MD5_MIN(t * per, frames);
+		jobs[t].count = t == threads - 1 ? frames - jobs[t].first
+			: MD5_MIN(per, frames - jobs[t].first);
+		if (!t) continue;
+		err = pthread_create(&tids[t], NULL, md5anim_bake_thread, &jobs[t]);
+		assert(!err);
+	}
+	md5anim_bake_thread(&jobs[0]);
+	for (t=1; t<threads; t++)
+		pthread_join(tids[t], NULL);
+	free(jobs);
+	free(tids);
+}
+
+/* same joints, in the same order, with the same parents. the check a load
+ * against model makes, by shared id. */
+int md5anim_matches(const struct md5anim *anim,
+		const struct md5model *model) {
+	int i;
+
+	if (anim->num.joints != model->num.joints) return 0;
+	for (i=0; i<anim->num.joints; i++)
+		if (anim->jinfo[i].parent != model->jinfo[i].parent
+				|| anim->jinfo[i].shared != model->jinfo[i].shared)
+			return 0;
+	return 1;
+}
+
+/* joint index by name, -1 when the clip has no such joint. */
+int md5anim_joint(const struct md5anim *anim, const char *name) {
+	int id = md5names_id(&anim->names, name);
+	return id < 0 ? -1 : md5names_value(&anim->names, id);
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* maps every model joint to the clip joint of the same name. missing ones
+ * hold the model's base pose, expressed relative to their parent. returns
+ * how many model joints the clip does not animate. */
+int md5anim_bind(struct md5bind *bind, const struct md5anim *anim,
+		const struct md5model *model) {
+	int i, missing=0;
+
+	bind->anim = anim;
+	bind->joints = model->num.joints;
+	bind->remap = malloc(sizeof(int) * MD5_MAX(bind->joints, 1));
+	assert(bind->remap);
+	bind->parent = malloc(sizeof(int) * MD5_MAX(bind->joints, 1));
+	assert(bind->parent);
+	bind->rest = malloc(sizeof(struct md5joint) * MD5_MAX(bind->joints, 1));
+	assert(bind->rest);
+
+	for (i=0; i<bind->joints; i++) {
+		const struct md5joint *base = &model->base[i];
+		int parent = model->jinfo[i].parent;
+
+		bind->parent[i] = parent;
+		bind->remap[i] = md5anim_joint(anim, model->jinfo[i].name);
+		if (bind->remap[i] < 0) missing++;
+
+		if (parent < 0) {
+			bind->rest[i] = *base;
+		} else {
+			const struct md5joint *pbase = &model->base[parent];
+			quat_t inv;
+			v3_t d;
+
+			quat_conjugate(&inv, &pbase->ori);
+			v3_sub(&d, &base->pos, &pbase->pos);
+			quat_rotatep(&bind->rest[i].pos, &inv, &d);
+			quat_mulq(&bind->rest[i].ori, &inv, &base->ori);
+		}
+	}
+	return missing;
+}
+
+/* same work per joint as building a native pose, plus one table lookup. */
+void md5anim_pose(const struct md5bind *bind, int frame,
+		struct md5joint *out) {
+	int i;
+	const struct md5joint *local = bind->anim->local[frame];
+
+	for (i=0; i<bind->joints; i++) {
+		int parent = bind->parent[i], src = bind->remap[i];
+		md5joint_compose(&out[i], parent < 0 ? NULL : &out[parent],
+				src < 0 ? &bind->rest[i] : &local[src]);
+	}
+}
+
+void md5bind_end(struct md5bind *bind) {
+	free(bind->remap);
+	free(bind->parent);
+	free(bind->rest);
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* verts is the largest mesh the pose will skin. */
+void md5pose_init(struct md5pose *pose, int joints, int verts, float eps) {
+	pose->joints = joints;
+	pose->verts = verts;
+	pose->changed = joints;
+	pose->fresh = 1;
+	pose->eps = eps;
+	pose->skel = malloc(sizeof(struct md5joint) * MD5_MAX(joints, 1));
+	assert(pose->skel);
+	pose->skinned = malloc(sizeof(struct md5joint) * MD5_MAX(joints, 1));
+	assert(pose->skinned);
+	pose->dirty = malloc(MD5_MAX(joints, 1));
+	assert(pose->dirty);
+	pose->mark = malloc(MD5_MAX(verts, 1));
+	assert(pose->mark);
+	pose->list = malloc(sizeof(int) * MD5_MAX(verts, 1));
+	assert(pose->list);
+}
+
+static int md5pose_moved(const struct md5joint *a, const struct md5joint *b,
+		float eps) {
+	return fabs(a->pos.x - b->pos.x) > eps
+		|| fabs(a->pos.y - b->pos.y) > eps
+		|| fabs(a->pos.z - b->pos.z) > eps
+		|| fabs(a->ori.x - b->ori.x) > eps
+		|| fabs(a->ori.y - b->ori.y) > eps
+		|| fabs(a->ori.z - b->ori.z) > eps
+		|| fabs(a->ori.w - b->ori.w) > eps;
+}
+
+/* takes skel as the new pose, returns how many joints are dirty. joints under
+ * eps keep their old reference so slow drift still gets picked up. */
+int md5pose_set(struct md5pose *pose, const struct md5joint *skel) {
+	int i;
+
+	pose->changed = 0;
+	for (i=0; i<pose->joints; i++) {
+		pose->skel[i] = skel[i];
+		pose->dirty[i] = pose->fresh
+			|| md5pose_moved(&pose->skinned[i], &skel[i], pose->eps);
+		if (pose->dirty[i]) {
+			pose->skinned[i] = skel[i];
+			pose->changed++;
+		}
+	}
+	pose->fresh = 0;
+	return pose->changed;
+}
+
+void md5pose_end(struct md5pose *pose) {
+	free(pose->skel);
+	free(pose->skinned);
+	free(pose->dirty);
+	free(pose->mark);
+	free(pose->list);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -138,28 +389,42 @@ static int md5anim_validade_model(const struct md5builder *build,
 	int i;
 
 	/* no info, assume it is correct. */
-	if (!model->jinfo) return 1;
+	if (!model || !model->jinfo) return 1;
 
 	if (build->num.joints != model->num.joints)
 		return 0;
-	for (i=0; i<build->num.joints; i++) {
-		if (build->hierarchy[i].parent != model->jinfo[i].parent)
-			return 0;
-		if (strcmp(build->hierarchy[i].name, model->jinfo[i].name))
+	/* the same shared id is the same name. */
+	for (i=0; i<build->num.joints; i++)
+		if (build->hierarchy[i].parent != model->jinfo[i].parent
+				|| build->hierarchy[i].shared != model->jinfo[i].shared)
 			return 0;
-	}
 	return 1;
 }
 
-static void md5anim_build_skeleton(struct md5builder *build,
+/* model space joint from its parent's and its own local transform. */
+static void md5joint_compose(struct md5joint *out,
+		const struct md5joint *parent, const struct md5joint *local) {
+	v3_t pos;
+
+	if (!parent) { /* root */
+		*out = *local;
+		return;
+	}
+	/* rotate pos acording to parent ori. */
+	quat_rotatep(&pos, &parent->ori, &local->pos);
+	v3_add(&out->pos, &pos, &parent->pos);
+	quat_mulq(&out->ori, &parent->ori, &local->ori);
+}
+
+/* local transforms of one frame, base pose overridden by its components. */
+static void md5anim_decode(struct md5builder *build,
 		float *framedata,
-		struct md5joint *out) {
+		struct md5joint *local) {
 	int joint;
 
 	for (joint=0; joint<build->num.joints; joint++) {
 		struct md5joint *base = &build->base[joint];
 
-		int parent =      build->hierarchy[joint].parent;
 		int start_index = build->hierarchy[joint].start_index;
 		int flags =       build->hierarchy[joint].flags;
 		int j=0;
@@ -176,16 +441,70 @@ static void md5anim_build_skeleton(struct md5builder *build,
 		if (flags & MD5_FLAG_ORI_Z) ori.z = framedata[start_index + j++];
 
 		quat_calcw(&ori);
-		if (parent < 0) { /* root */
-			out[joint].ori = ori;
-			out[joint].pos = pos;
-		} else {
-			/* rotate pos acording to parent ori. */
-			quat_rotatep(&pos, &out[parent].ori, &pos);
-			v3_add(&out[joint].pos, &pos, &out[parent].pos);
-			quat_mulq(&out[joint].ori, &out[parent].ori, &ori);
+		local[joint].ori = ori;
+		local[joint].pos = pos;
+	}
+}
+
+/* model space joints of frames [first, first+count) from their locals, a
+ * batch of frames at a time with each joint's frames in SIMD lanes. does
+ * the same float operations as md5joint_compose, poses come out identical. */
+static void md5anim_bake_range(struct md5anim *anim, int first, int count) {
+	int i, j, c, n, joints = anim->num.joints;
+	float *soa, *lcomp[7];
+	const float *mcomp[7], **in;
+	float **out;
+	quatsoa_t lo, mo, po;
+	v3soa_t lp, mp, pp;
+
+	/* 7 model space component arrays per joint, then one joint's locals. */
+	soa = malloc(sizeof(float) * 7 * MD5_BAKE_BATCH * (joints + 1));
+	assert(soa);
+	in = malloc(sizeof(float *) * MD5_BAKE_BATCH);
+	assert(in);
+	out = malloc(sizeof(float *) * MD5_BAKE_BATCH);
+	assert(out);
+	for (c=0; c<7; c++)
+		lcomp[c] = soa + 7 * MD5_BAKE_BATCH * joints + c * MD5_BAKE_BATCH;
+	MD5_BAKE_SOA(lp, lo, lcomp[0]);
+
+	for (; count > 0; first += n, count -= n) {
+		n = MD5_MIN(count, MD5_BAKE_BATCH);
+		for (i=0; i<n; i++) {
+			in[i] = &anim->local[first + i][0].pos.x;
+			out[i] = &anim->joints[first + i][0].pos.x;
+		}
+		for (j=0; j<joints; j++) {
+			int parent = anim->jinfo[j].parent;
+			float *m = soa + 7 * MD5_BAKE_BATCH * j;
+
+			soa_gather_n(lcomp, in, 7 * j, 7, n);
+
+			MD5_BAKE_SOA(mp, mo, m);
+			if (parent < 0) { /* root */
+				memcpy(m, lcomp[0], sizeof(float) * 7 * MD5_BAKE_BATCH);
+			} else {
+				/* parents come first, theirs are done. */
+				MD5_BAKE_SOA(pp, po, soa + 7 * MD5_BAKE_BATCH * parent);
+				quat_rotatep_n(&mp, &po, &lp, n);
+				v3_add_n(&mp, &mp, &pp, n);
+				quat_mulq_n(&mo, &po, &lo, n);
+			}
+
+			for (c=0; c<7; c++)
+				mcomp[c] = m + c * MD5_BAKE_BATCH;
+			soa_scatter_n(out, 7 * j, mcomp, 7, n);
 		}
 	}
+	free(soa);
+	free(in);
+	free(out);
+}
+
+static void *md5anim_bake_thread(void *udata) {
+	struct md5bake_job *job = udata;
+	md5anim_bake_range(job->anim, job->first, job->count);
+	return NULL;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -194,10 +513,9 @@ static void md5anim_build_skeleton(struct md5builder *build,
 
 
 static int md5parse_hierarchy(FILE *in, struct md5hierarchy *hierarchy,
-		int count) {
+		struct md5names *names, int count) {
 	int i;
 	char *name=NULL;
-	size_t namesz;
 
 	if (!md5lex_checktk(in, "hierarchy")) return 1;
 	if (!md5lex_checktk(in, "{")) return 2;
@@ -205,9 +523,10 @@ static int md5parse_hierarchy(FILE *in, struct md5hierarchy *hierarchy,
 	for (i=0; i<count; i++) {
 		struct md5hierarchy *hie = &hierarchy[i];
 
-		if (!md5lex_readstring(in, &name, &namesz)) return 3;
-		strncpy(hie->name, name, MD5_MIN(namesz, MD5_MAX_NAME_SZ));
-		free(name); name=NULL; /* throw it away. */
+		if (!md5lex_readstring(in, &name, NULL)) return 3;
+		hie->name = md5names_intern(names, name, i);
+		hie->shared = md5names_shared(name);
+		free(name); name=NULL; /* interned, throw it away. */
 
 		if (!md5lex_readint(in, &hie->parent)) return 4;
 		if (!md5lex_readint(in, &hie->flags)) return 5;
@@ -288,7 +607,9 @@ static int md5parse_frames(FILE *in, float **framedata,
 /* -------------------------------------------------------------------------- */
 
 static void md5builder_init(struct md5builder *build) {
+	build->num.frames = build->num.joints = 0;
 	build->hierarchy = NULL;
+	md5names_init(&build->names);
 	build->base = NULL;
 	build->bounds = NULL;
 	build->framedata = NULL;
@@ -298,9 +619,11 @@ static void md5builder_end(struct md5builder *build) {
 	int i;
 
 	/* free(NULL) is fine, a NOP by ANSI spec. */
-	for (i=0; i<build->num.frames; i++)
+	for (i=0; build->framedata && i<build->num.frames; i++)
 		free(build->framedata[i]);
 	free(build->hierarchy);
 	free(build->bounds);
+	free(build->base);
 	free(build->framedata);
+	md5names_end(&build->names);
 }
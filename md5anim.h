@@ -7,21 +7,66 @@
 #include "quat.h"
 #include "v3.h"
 
-struct md5bbox {
-	v3_t min, max;
-};
-
 struct md5anim {
 	struct {int joints, frames; } num;
-	struct md5joint **joints;
+	struct md5joint **joints;   /* model space, in the clip's own hierarchy. */
+	struct md5joint **local;    /* relative to the parent joint. */
 	struct md5bbox *bounds;
+	struct md5jinfo *jinfo;
+	struct md5names names;  /* joint names, valued by joint index. */
 };
 
+/* a clip bound to a model, possibly with a different skeleton. */
+struct md5bind {
+	const struct md5anim *anim;
+	int joints;               /* the model's. */
+	int *remap;               /* clip joint per model joint, -1 if missing. */
+	int *parent;
+	struct md5joint *rest;    /* model base pose, local, for missing joints. */
+};
+
+/* per instance pose, remembers the joints its vertices were last skinned
+ * against and flags the ones that moved further than eps since then. mark
+ * and list are md5model_skin_dirty's scratch, for meshes of up to verts
+ * vertices. */
+struct md5pose {
+	int joints, verts, changed, fresh;
+	float eps;
+	struct md5joint *skel, *skinned;
+	unsigned char *dirty, *mark;
+	int *list;
+};
+
+/* model may be NULL to skip checking the clip against it, bind it later. */
 int
 md5anim_load(const char *, struct md5anim *, struct md5model *);
 int
 md5anim_read(FILE *, struct md5anim *, struct md5model *);
+int
+md5anim_read_threads(FILE *, struct md5anim *, struct md5model *,
+		int threads);
 void
 md5anim_end(struct md5anim *);
+void
+md5anim_bake(struct md5anim *, int threads);
+int
+md5anim_joint(const struct md5anim *, const char *name);
+int
+md5anim_matches(const struct md5anim *, const struct md5model *);
+
+int
+md5anim_bind(struct md5bind *, const struct md5anim *,
+		const struct md5model *);
+void
+md5anim_pose(const struct md5bind *, int frame, struct md5joint *);
+void
+md5bind_end(struct md5bind *);
+
+void
+md5pose_init(struct md5pose *, int joints, int verts, float eps);
+int
+md5pose_set(struct md5pose *, const struct md5joint *);
+void
+md5pose_end(struct md5pose *);
 
 #endif /* MD5ANIM_H */
@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "md5async.h"
+
+static void *md5async_worker(void *);
+static struct md5job *md5async_pick(struct md5async *);
+static void md5async_unlink(struct md5job **, struct md5job *);
+static void md5async_undone(struct md5async *, struct md5job *);
+static void md5job_discard(struct md5job *);
+
+/* -------------------------------------------------------------------------- */
+
+void md5job_model(struct md5job *job, const char *fname,
+		struct md5model *model) {
+	job->type = MD5_JOB_MODEL;
+	job->fname = fname;
+	job->model = model;
+	job->anim = NULL;
+	job->after = NULL;
+	job->done = NULL;
+	job->udata = NULL;
+	job->state = MD5_JOB_IDLE;
+	job->err = job->cancel = 0;
+	job->waiters = 0;
+	job->next = NULL;
+}
+
+void md5job_anim(struct md5job *job, const char *fname,
+		struct md5anim *anim, struct md5model *model, struct md5job *after) {
+	md5job_model(job, fname, model);
+	job->type = MD5_JOB_ANIM;
+	job->anim = anim;
+	job->after = after;
+}
+
+/* -------------------------------------------------------------------------- */
+
+int md5async_init(struct md5async *pool, int threads) {
+	int i;
+
+	assert(threads > 0);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->finish, NULL);
+	for (i=0; i<MD5_PRIO_COUNT; i++)
+		pool->queue[i] = NULL;
+	pool->done = pool->done_tail = NULL;
+	pool->quit = 0;
+
+	pool->threads = malloc(sizeof(pthread_t) * threads);
+	assert(pool->threads);
+	for (i=0; i<threads; i++)
+		if (pthread_create(&pool->threads[i], NULL, md5async_worker, pool))
+			break;
+	pool->num_threads = i;
+	if (!i) {
+		md5async_end(pool);
+		return 1;
+	}
+	return 0;
+}
+
+void md5async_end(struct md5async *pool) {
+	int i;
+	struct md5job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	for (i=0; i<MD5_PRIO_COUNT; i++) {
+		while ((job = pool->queue[i])) {
+			pool->queue[i] = job->next;
+			if (job->after) job->after->waiters--;
+			job->state = MD5_JOB_CANCELLED;
+			job->err = MD5_ASYNC_CANCELLED;
+		}
+	}
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i=0; i<pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+	free(pool->threads);
+
+	/* whatever was loaded but never dispatched still belongs to us. */
+	for (job = pool->done; job; job = job->next) {
+		md5job_discard(job);
+		job->state = MD5_JOB_CANCELLED;
+		job->err = MD5_ASYNC_CANCELLED;
+	}
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->finish);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+void md5async_submit(struct md5async *pool, struct md5job *job, int prio) {
+	struct md5job **tail;
+
+	assert(prio >= 0 && prio < MD5_PRIO_COUNT);
+	pthread_mutex_lock(&pool->lock);
+	job->prio = prio;
+	job->state = MD5_JOB_QUEUED;
+	job->err = job->cancel = 0;
+	job->next = NULL;
+	if (job->after) job->after->waiters++;
+	for (tail = &pool->queue[prio]; *tail; tail = &(*tail)->next);
+	*tail = job;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int md5async_state(struct md5async *pool, struct md5job *job) {
+	int state;
+
+	pthread_mutex_lock(&pool->lock);
+	state = job->state;
+	pthread_mutex_unlock(&pool->lock);
+	return state;
+}
+
+/* dispatches every finished job on the calling thread. */
+int md5async_poll(struct md5async *pool) {
+	int n=0;
+	struct md5job *job, *next;
+
+	pthread_mutex_lock(&pool->lock);
+	job = pool->done;
+	pool->done = pool->done_tail = NULL;
+	for (next = job; next; next = next->next)
+		next->state = MD5_JOB_FINISHED;
+	pthread_mutex_unlock(&pool->lock);
+
+	for (; job; job = next, n++) {
+		next = job->next;
+		if (job->done) job->done(job, job->udata);
+	}
+	return n;
+}
+
+/* blocks until job leaves the pool, dispatching it if it was loaded. */
+int md5async_wait(struct md5async *pool, struct md5job *job) {
+	pthread_mutex_lock(&pool->lock);
+	while (job->state == MD5_JOB_QUEUED || job->state == MD5_JOB_RUNNING)
+		pthread_cond_wait(&pool->finish, &pool->lock);
+	if (job->state != MD5_JOB_DONE) {
+		pthread_mutex_unlock(&pool->lock);
+		return job->err;
+	}
+
+	md5async_undone(pool, job);
+	job->state = MD5_JOB_FINISHED;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (job->done) job->done(job, job->udata);
+	return job->err;
+}
+
+/* 0 when job will never be dispatched, 1 when it is too late for that. a
+ * loaded job is not thrown away while jobs that load against it are still
+ * queued or running, it is dispatched as usual. */
+int md5async_cancel(struct md5async *pool, struct md5job *job) {
+	int ret=0;
+
+	pthread_mutex_lock(&pool->lock);
+	switch (job->state) {
+	case MD5_JOB_QUEUED:
+		md5async_unlink(&pool->queue[job->prio], job);
+		if (job->after) job->after->waiters--;
+		job->state = MD5_JOB_CANCELLED;
+		job->err = MD5_ASYNC_CANCELLED;
+		/* dependents are runnable now, they fail on their own. */
+		pthread_cond_broadcast(&pool->work);
+		pthread_cond_broadcast(&pool->finish);
+		break;
+	case MD5_JOB_RUNNING:
+		job->cancel = 1; /* the worker throws the result away. */
+		break;
+	case MD5_JOB_DONE:
+		if (job->waiters) {
+			ret = 1;
+			break;
+		}
+		md5async_undone(pool, job);
+		md5job_discard(job);
+		job->state = MD5_JOB_CANCELLED;
+		job->err = MD5_ASYNC_CANCELLED;
+		break;
+	default:
+		ret = 1;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void *md5async_worker(void *arg) {
+	struct md5async *pool = arg;
+	struct md5job *job;
+	int err;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->quit) {
+		if (!(job = md5async_pick(pool))) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+			continue;
+		}
+
+		if (job->after && (job->after->state == MD5_JOB_CANCELLED
+					|| job->after->err)) {
+			err = MD5_ASYNC_DEPFAIL;
+		} else {
+			job->state = MD5_JOB_RUNNING;
+			pthread_mutex_unlock(&pool->lock);
+			if (job->type == MD5_JOB_MODEL)
+				err = md5model_load(job->fname, job->model);
+			else
+				err = md5anim_load(job->fname, job->anim, job->model);
+			pthread_mutex_lock(&pool->lock);
+		}
+
+		job->err = err;
+		if (job->after) job->after->waiters--;
+		if (job->cancel) {
+			md5job_discard(job);
+			job->state = MD5_JOB_CANCELLED;
+			job->err = MD5_ASYNC_CANCELLED;
+		} else {
+			job->state = MD5_JOB_DONE;
+			job->next = NULL;
+			if (pool->done_tail) pool->done_tail->next = job;
+			else pool->done = job;
+			pool->done_tail = job;
+		}
+		pthread_cond_broadcast(&pool->work);
+		pthread_cond_broadcast(&pool->finish);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/* highest priority job first, skipping the ones whose dependency is pending. */
+static struct md5job *md5async_pick(struct md5async *pool) {
+	int prio;
+	struct md5job *job;
+
+	for (prio=MD5_PRIO_COUNT-1; prio>=0; prio--) {
+		for (job = pool->queue[prio]; job; job = job->next) {
+			if (job->after && job->after->state < MD5_JOB_DONE)
+				continue;
+			md5async_unlink(&pool->queue[prio], job);
+			return job;
+		}
+	}
+	return NULL;
+}
+
+static void md5async_unlink(struct md5job **list, struct md5job *job) {
+	for (; *list; list = &(*list)->next) {
+		if (*list == job) {
+			*list = job->next;
+			break;
+		}
+	}
+	job->next = NULL;
+}
+
+static void md5async_undone(struct md5async *pool, struct md5job *job) {
+	struct md5job *prev=NULL;
+
+	if (pool->done != job)
+		for (prev = pool->done; prev->next != job; prev = prev->next);
+	md5async_unlink(&pool->done, job);
+	if (pool->done_tail == job) pool->done_tail = prev;
+}
+
+/* a load that failed has already freed what it read. */
+static void md5job_discard(struct md5job *job) {
+	if (job->err) return;
+	if (job->type == MD5_JOB_MODEL) md5model_end(job->model);
+	else md5anim_end(job->anim);
+}
@@ -0,0 +1,69 @@
+#ifndef MD5ASYNC_H
+#define MD5ASYNC_H
+
+#include <pthread.h>
+#include "md5model.h"
+#include "md5anim.h"
+
+/* job errors, loader errors are passed through untouched. */
+#define MD5_ASYNC_CANCELLED (-100)
+#define MD5_ASYNC_DEPFAIL   (-101)
+
+enum md5prio {
+	MD5_PRIO_LOW,
+	MD5_PRIO_NORMAL,
+	MD5_PRIO_HIGH,
+	MD5_PRIO_COUNT
+};
+
+enum md5jobstate {
+	MD5_JOB_IDLE,
+	MD5_JOB_QUEUED,
+	MD5_JOB_RUNNING,
+	MD5_JOB_DONE,      /* loaded, waiting for poll/wait to dispatch it. */
+	MD5_JOB_FINISHED,  /* dispatched on the caller's thread. */
+	MD5_JOB_CANCELLED
+};
+
+struct md5job;
+typedef void (*md5job_fn)(struct md5job *, void *);
+
+/* owned by the caller, it (and fname) must outlive the job. */
+struct md5job {
+	enum { MD5_JOB_MODEL, MD5_JOB_ANIM } type;
+	const char *fname;
+	struct md5model *model;
+	struct md5anim *anim;
+	struct md5job *after; /* anims validate against a model still loading. */
+
+	md5job_fn done;       /* called on the thread that polls/waits. */
+	void *udata;
+
+	int prio, state, err, cancel;
+	int waiters;          /* submitted jobs with this one as after, not done. */
+	struct md5job *next;
+};
+
+struct md5async {
+	pthread_mutex_t lock;
+	pthread_cond_t work, finish;
+	pthread_t *threads;
+	int num_threads, quit;
+
+	struct md5job *queue[MD5_PRIO_COUNT];
+	struct md5job *done, *done_tail;
+};
+
+void md5job_model(struct md5job *, const char *fname, struct md5model *);
+void md5job_anim(struct md5job *, const char *fname,
+		struct md5anim *, struct md5model *, struct md5job *after);
+
+int  md5async_init(struct md5async *, int threads);
+void md5async_end(struct md5async *);
+void md5async_submit(struct md5async *, struct md5job *, int prio);
+int  md5async_state(struct md5async *, struct md5job *);
+int  md5async_poll(struct md5async *);
+int  md5async_wait(struct md5async *, struct md5job *);
+int  md5async_cancel(struct md5async *, struct md5job *);
+
+#endif /* MD5ASYNC_H */
@@ -0,0 +1,2113 @@
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "md5model.h"
+#include "md5anim.h"
+#include "md5cache.h"
+#include "md5bvh.h"
+#include "md5gen.h"
+#include "md5sched.h"
+#include "md5shadow.h"
+#include "md5watch.h"
+#include "md5snap.h"
+
+/* micro benchmarks of the library hot paths, no display needed. */
+
+struct bench_cmd {
+	const char *name, *usage;
+	int args;
+	int (*run)(int, char **);
+};
+
+static int bench_skin(int, char **);
+static int bench_dirty(int, char **);
+static int bench_cache(int, char **);
+static int bench_geo(int, char **);
+static int bench_bvh(int, char **);
+static int bench_retarget(int, char **);
+static int bench_gen(int, char **);
+static int bench_sweep(int, char **);
+static int bench_sched(int, char **);
+static int bench_bake(int, char **);
+static int bench_shadow(int, char **);
+static int bench_capsule(int, char **);
+static int bench_dedup(int, char **);
+static int bench_watch(int, char **);
+static int bench_bounds(int, char **);
+static int bench_snap(int, char **);
+static int bench_truncate(int, char **);
+static int bench_async(int, char **);
+static int bench_md5c(int, char **);
+
+static const struct bench_cmd bench_cmds[] = {
+	{ "skin", "<md5mesh> <md5anim> [passes]", 2, bench_skin },
+	{ "dirty", "<md5mesh> <md5anim> [eps] [passes]", 2, bench_dirty },
+	{ "cache", "<md5mesh> <md5anim> [instances] [budget KB] [ticks]", 2,
+		bench_cache },
+	{ "geo", "[count] [passes]", 0, bench_geo },
+	{ "bvh", "<md5mesh> <md5anim> [rays per frame]", 2, bench_bvh },
+	{ "retarget", "<md5mesh> <md5anim> [other md5mesh] [passes]", 2,
+		bench_retarget },
+	{ "gen", "<prefix> [joints] [depth] [verts] [weights] [frames] [animated]",
+		1, bench_gen },
+	{ "sweep", "[joints|depth|verts|weights|frames|animated] [passes]", 0,
+		bench_sweep },
+	{ "sched", "<md5mesh> <md5anim> [instances] [budget] [ticks] [max interval]",
+		2, bench_sched },
+	{ "bake", "<md5mesh> <md5anim> [threads] [passes]", 2, bench_bake },
+	{ "shadow", "<md5mesh> <md5anim> [passes]", 2, bench_shadow },
+	{ "capsule", "<md5mesh> <md5anim> [passes]", 2, bench_capsule },
+	{ "dedup", "<md5mesh> [md5mesh...]", 1, bench_dedup },
+	{ "watch", "<md5mesh> <md5anim> <scratch dir> [edits]", 3, bench_watch },
+	{ "bounds", "<md5mesh> <md5anim> [passes]", 2, bench_bounds },
+	{ "snap", "<md5anim> [pos step] [passes]", 1, bench_snap },
+	{ "truncate", "<md5mesh|md5anim...>", 1, bench_truncate },
+	{ "async", "<md5mesh> <md5anim> [rounds]", 2, bench_async },
+	{ "md5c", "<md5c> <scratch dir> [md5mesh...]", 2, bench_md5c },
+};
+#define BENCH_NUM_CMDS ((int)(sizeof(bench_cmds) / sizeof(bench_cmds[0])))
+
+/* -------------------------------------------------------------------------- */
+
+static double bench_seconds(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* wall clock seconds, cpu time adds up over threads. */
+static double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench_load(const char *mesh, const char *anim,
+		struct md5model *model, struct md5anim *clip) {
+	int err;
+
+	if ((err = md5model_load(mesh, model))) {
+		fprintf(stderr, "%s: md5model %d\n", mesh, err);
+		return 1;
+	}
+	if (anim && (err = md5anim_load(anim, clip, model))) {
+		fprintf(stderr, "%s: md5anim %d\n", anim, err);
+		md5model_end(model);
+		return 1;
+	}
+	return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static double bench_skin_pass(struct md5model *model, struct md5anim *anim,
+		int passes, void (*skin)(struct md5mesh *, struct md5joint *)) {
+	int p, f, m;
+	clock_t start = clock();
+
+	for (p=0; p<passes; p++)
+		for (f=0; f<anim->num.frames; f++)
+			for (m=0; m<model->num.meshes; m++)
+				skin(&model->meshes[m], anim->joints[f]);
+	return bench_seconds(start);
+}
+
+static double bench_skin_format(struct md5model *model, struct md5anim *anim,
+		int passes, struct md5vfmt *fmt, void *buf) {
+	int p, f, m;
+	clock_t start = clock();
+
+	for (p=0; p<passes; p++) {
+		for (f=0; f<anim->num.frames; f++) {
+			fmt->bounds = anim->bounds[f];
+			for (m=0; m<model->num.meshes; m++)
+				md5model_skin(&model->meshes[m], anim->joints[f], fmt, buf);
+		}
+	}
+	return bench_seconds(start);
+}
+
+static int bench_skin(int argc, char **argv) {
+	int i, m, b, passes, verts=0, hist[MD5_SKIN_BUCKETS] = {0};
+	double generic, bucketed, diff=0;
+	struct md5model model;
+	struct md5anim anim;
+	v3_t **ref;
+
+	passes = argc > 2 ? atoi(argv[2]) : 20;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+
+	ref = malloc(sizeof(v3_t *) * model.num.meshes);
+	assert(ref);
+	for (m=0; m<model.num.meshes; m++) {
+		struct md5mesh *mesh = &model.meshes[m];
+
+		for (b=0; b<MD5_SKIN_BUCKETS; b++)
+			hist[b] += mesh->skin.start[b+1] - mesh->skin.start[b];
+		verts += mesh->num.verts;
+
+		ref[m] = malloc(sizeof(v3_t) * MD5_MAX(mesh->num.verts, 1));
+		assert(ref[m]);
+		md5model_mkmesh_generic(mesh, anim.joints[0]);
+		for (i=0; i<mesh->num.verts; i++)
+			ref[m][i] = mesh->verts[i].pos;
+		md5model_mkmesh(mesh, anim.joints[0]);
+		for (i=0; i<mesh->num.verts; i++) {
+			v3_t d;
+			v3_sub(&d, &ref[m][i], &mesh->verts[i].pos);
+			diff = MD5_MAX(diff, v3_norm(&d));
+		}
+		free(ref[m]);
+	}
+	free(ref);
+
+	printf("%d verts, by weight count:", verts);
+	for (b=0; b<MD5_SKIN_BUCKETS; b++)
+		printf(" %s%d=%d", b == MD5_SKIN_BUCKETS-1 ? ">=" : "", b+1, hist[b]);
+	for (b=0, i=verts; b<MD5_SKIN_BUCKETS; b++)
+		i -= hist[b];
+	printf(" copies=%d\nmax difference %g\n", i, diff);
+	if (diff > 1e-3) fprintf(stderr, "bucketed skin does not match\n");
+
+	generic = bench_skin_pass(&model, &anim, passes, md5model_mkmesh_generic);
+	bucketed = bench_skin_pass(&model, &anim, passes, md5model_mkmesh);
+	i = passes * anim.num.frames;
+	printf("generic  %8.3f us/frame\n", 1e6 * generic / i);
+	printf("bucketed %8.3f us/frame (%.2fx)\n", 1e6 * bucketed / i,
+			bucketed > 0 ? generic / bucketed : 0);
+
+	{
+		static const char *names[] = { "f32", "f16", "snorm16" };
+		struct md5vfmt fmt;
+		void *buf;
+
+		fmt.st = 1;
+		fmt.stride = 0;
+		for (m=0, b=0; m<model.num.meshes; m++)
+			b = MD5_MAX(b, model.meshes[m].num.verts);
+		buf = malloc(sizeof(float) * 5 * MD5_MAX(b, 1));
+		assert(buf);
+		for (fmt.type=MD5_VFMT_F32; fmt.type<=MD5_VFMT_SNORM16; fmt.type++) {
+			double t = bench_skin_format(&model, &anim, passes, &fmt, buf);
+			printf("%-8s %8.3f us/frame, %2d bytes/vertex with st\n",
+					names[fmt.type], 1e6 * t / i, (int)md5vfmt_size(&fmt));
+		}
+		free(buf);
+	}
+
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return diff > 1e-3;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* frame 0 held, with only the last moving joints following the clip. */
+static void bench_dirty_part(struct md5model *model, struct md5anim *anim,
+		int moving, int passes, v3_t **out, v3_t *ref) {
+	int p, f, m, j, frames = anim->num.frames, joints = model->num.joints;
+	long skinned=0, verts=0;
+	double t, full;
+	clock_t start;
+	struct md5pose pose;
+	struct md5vfmt fmt;
+	struct md5joint *skel;
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	skel = malloc(sizeof(struct md5joint) * frames * MD5_MAX(joints, 1));
+	assert(skel);
+	for (f=0; f<frames; f++)
+		for (j=0; j<joints; j++)
+			skel[f * joints + j] = anim->joints[j < joints - moving ? 0 : f][j];
+	for (m=0, j=1; m<model->num.meshes; m++)
+		j = MD5_MAX(j, model->meshes[m].num.verts);
+	md5pose_init(&pose, joints, j, 0);
+
+	start = clock();
+	for (p=0; p<passes; p++) {
+		for (f=0; f<frames; f++) {
+			md5pose_set(&pose, &skel[f * joints]);
+			for (m=0; m<model->num.meshes; m++) {
+				skinned += model->meshes[m].num.verts
+					- md5model_skin_dirty(&model->meshes[m], pose.skel,
+							pose.dirty, pose.mark, pose.list, &fmt, out[m]);
+				verts += model->meshes[m].num.verts;
+			}
+		}
+	}
+	t = bench_seconds(start);
+	start = clock();
+	for (p=0; p<passes; p++)
+		for (f=0; f<frames; f++)
+			for (m=0; m<model->num.meshes; m++)
+				md5model_skin(&model->meshes[m], &skel[f * joints], &fmt, ref);
+	full = bench_seconds(start);
+
+	printf("%3d moving, %5.1f%% of verts skinned: full %8.3f  dirty %8.3f"
+			" us/frame (%.2fx)\n", moving, 100.0 * skinned / verts,
+			1e6 * full / (passes * frames), 1e6 * t / (passes * frames),
+			t > 0 ? full / t : 0);
+	md5pose_end(&pose);
+	free(skel);
+}
+
+static int bench_dirty(int argc, char **argv) {
+	int p, f, m, passes, frames, joints=0;
+	long skipped=0, verts=0;
+	double t, full, err=0;
+	clock_t start;
+	float eps;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5pose pose;
+	struct md5vfmt fmt;
+	v3_t **out, *ref;
+
+	eps = argc > 2 ? atof(argv[2]) : 1e-4;
+	passes = argc > 3 ? atoi(argv[3]) : 20;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	out = malloc(sizeof(v3_t *) * model.num.meshes);
+	assert(out);
+	for (m=0, f=1; m<model.num.meshes; m++) {
+		f = MD5_MAX(f, model.meshes[m].num.verts);
+		out[m] = malloc(sizeof(v3_t) * MD5_MAX(model.meshes[m].num.verts, 1));
+		assert(out[m]);
+	}
+	ref = malloc(sizeof(v3_t) * f);
+	assert(ref);
+
+	md5pose_init(&pose, model.num.joints, f, eps);
+	frames = passes * anim.num.frames;
+	start = clock();
+	for (p=0; p<passes; p++) {
+		for (f=0; f<anim.num.frames; f++) {
+			joints += md5pose_set(&pose, anim.joints[f]);
+			for (m=0; m<model.num.meshes; m++) {
+				skipped += md5model_skin_dirty(&model.meshes[m], pose.skel,
+						pose.dirty, pose.mark, pose.list, &fmt, out[m]);
+				verts += model.meshes[m].num.verts;
+			}
+		}
+	}
+	t = bench_seconds(start);
+	full = bench_skin_format(&model, &anim, passes, &fmt, ref);
+
+	/* drift against a full skin of the last frame. */
+	f = anim.num.frames - 1;
+	for (m=0; m<model.num.meshes; m++) {
+		int i;
+		md5model_skin(&model.meshes[m], anim.joints[f], &fmt, ref);
+		for (i=0; i<model.meshes[m].num.verts; i++) {
+			v3_t d;
+			v3_sub(&d, &ref[i], &out[m][i]);
+			err = MD5_MAX(err, v3_norm(&d));
+		}
+	}
+
+	printf("eps %g: %.1f of %d joints dirty, %.1f of %.1f verts skipped per frame\n",
+			eps, (double)joints / frames, model.num.joints,
+			(double)skipped / frames, (double)verts / frames);
+	/* only eps lets a vertex lag behind, at 0 it must not move at all. */
+	printf("max drift %g\n", err);
+	if (eps == 0 && err > 0) fprintf(stderr, "drift with eps 0\n");
+	printf("full  %8.3f us/frame\n", 1e6 * full / frames);
+	printf("dirty %8.3f us/frame (%.2fx)\n", 1e6 * t / frames,
+			t > 0 ? full / t : 0);
+	md5pose_end(&pose);
+
+	/* where the dirty path pays: fewer joints moving than the clip's. */
+	for (p=1; p<model.num.joints; p*=2)
+		bench_dirty_part(&model, &anim, p, passes, out, ref);
+	bench_dirty_part(&model, &anim, model.num.joints, passes, out, ref);
+
+	for (m=0; m<model.num.meshes; m++)
+		free(out[m]);
+	free(ref);
+	free(out);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return eps == 0 && err > 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* instances play the same clip at scattered offsets. */
+static int bench_cache(int argc, char **argv) {
+	int i, t, m, instances, ticks, baked, maxverts=1, ret=0;
+	size_t frame;
+	double skinned, cached;
+	clock_t start;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5cache cache;
+	struct md5vfmt fmt;
+	void *buf;
+
+	instances = argc > 2 ? atoi(argv[2]) : 64;
+	ticks = argc > 4 ? atoi(argv[4]) : 1000;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	md5cache_init(&cache, &fmt, (argc > 3 ? atol(argv[3]) : 65536) * 1024);
+	for (m=0; m<model.num.meshes; m++)
+		maxverts = MD5_MAX(maxverts, model.meshes[m].num.verts);
+	buf = malloc(md5vfmt_size(&fmt) * maxverts);
+	assert(buf);
+
+	start = clock();
+	for (t=0; t<ticks; t++)
+		for (i=0; i<instances; i++)
+			for (m=0; m<model.num.meshes; m++)
+				md5model_skin(&model.meshes[m],
+						anim.joints[(i * 37 + t) % anim.num.frames], &fmt, buf);
+	skinned = bench_seconds(start);
+
+	start = clock();
+	for (t=0; t<ticks; t++) {
+		for (i=0; i<instances; i++) {
+			int f = (i * 37 + t) % anim.num.frames;
+			for (m=0; m<model.num.meshes; m++)
+				if (!md5cache_get(&cache, &model, &anim, f, m))
+					md5model_skin(&model.meshes[m], anim.joints[f], &fmt, buf);
+		}
+	}
+	cached = bench_seconds(start);
+
+	printf("%d instances, %d ticks, %lu KB cached\n", instances, ticks,
+			(unsigned long)(cache.used / 1024));
+	printf("hits %ld misses %ld evictions %ld\n", cache.stats.hits,
+			cache.stats.misses, cache.stats.evictions);
+	printf("skinned %8.3f us/tick\n", 1e6 * skinned / ticks);
+	printf("cached  %8.3f us/tick (%.2fx)\n", 1e6 * cached / ticks,
+			cached > 0 ? skinned / cached : 0);
+
+	md5cache_end(&cache);
+
+	/* a clip baked into half of its size keeps the frames it reports. */
+	for (m=0, frame=0; m<model.num.meshes; m++)
+		frame += md5vfmt_size(&fmt) * MD5_MAX(model.meshes[m].num.verts, 1);
+	md5cache_init(&cache, &fmt, frame * anim.num.frames / 2);
+	baked = md5cache_bake(&cache, &model, &anim);
+	for (t=0; t<baked; t++)
+		for (m=0; m<model.num.meshes; m++)
+			md5cache_get(&cache, &model, &anim, t, m);
+	printf("baked %d of %d frames in half the clip, %ld misses after\n",
+			baked, anim.num.frames,
+			cache.stats.misses - (long)baked * model.num.meshes);
+	if (baked != anim.num.frames / 2 || cache.stats.evictions
+			|| cache.stats.misses != (long)baked * model.num.meshes) {
+		fprintf(stderr, "bake did not keep what it reported\n");
+		ret = 1;
+	}
+
+	md5cache_end(&cache);
+	free(buf);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static float bench_rand(void) {
+	return (float)rand() / RAND_MAX * 2 - 1;
+}
+
+/* the old q*v*q^-1 rotation, to check the cheaper formulation against. */
+static v3_t *bench_rotatep_ref(v3_t *out, const quat_t *q, const v3_t *in) {
+	quat_t tmp, inv;
+
+	quat_mulq(&tmp, quat_mulv(&tmp, q, in), quat_conjugate(&inv, q));
+	return v3_make(out, tmp.x, tmp.y, tmp.z);
+}
+
+/* batch functions against the scalar ones, on random unit quaternions. */
+static int bench_geo(int argc, char **argv) {
+	int i, p, n, passes;
+	float *mem;
+	double err_rot=0, err_batch=0, t_scalar, t_batch, t_ref;
+	clock_t start;
+	quatsoa_t q, qo;
+	v3soa_t v, vo;
+
+	n = argc > 0 ? atoi(argv[0]) : 4096;
+	passes = argc > 1 ? atoi(argv[1]) : 2000;
+	mem = malloc(sizeof(float) * n * 14);
+	assert(mem);
+	q.x = mem;       q.y = q.x + n;  q.z = q.y + n;  q.w = q.z + n;
+	qo.x = q.w + n;  qo.y = qo.x + n; qo.z = qo.y + n; qo.w = qo.z + n;
+	v.x = qo.w + n;  v.y = v.x + n;  v.z = v.y + n;
+	vo.x = v.z + n;  vo.y = vo.x + n; vo.z = vo.y + n;
+
+	for (i=0; i<n; i++) {
+		q.x[i] = bench_rand(); q.y[i] = bench_rand();
+		q.z[i] = bench_rand(); q.w[i] = bench_rand();
+		v.x[i] = 100 * bench_rand(); v.y[i] = 100 * bench_rand();
+		v.z[i] = 100 * bench_rand();
+	}
+	quat_normalize_n(&q, &q, n);
+
+	/* exactness of the batch paths. */
+	quat_rotatep_n(&vo, &q, &v, n);
+	quat_mulq_n(&qo, &q, &q, n);
+	for (i=0; i<n; i++) {
+		quat_t a, b;
+		v3_t r, o;
+
+		quat_fill(&a, q.x[i], q.y[i], q.z[i], q.w[i]);
+		v3_make(&r, v.x[i], v.y[i], v.z[i]);
+		quat_rotatep(&o, &a, &r);
+		err_batch = MD5_MAX(err_batch, fabs(o.x - vo.x[i]));
+		err_batch = MD5_MAX(err_batch, fabs(o.y - vo.y[i]));
+		err_batch = MD5_MAX(err_batch, fabs(o.z - vo.z[i]));
+		quat_mulq(&b, &a, &a);
+		err_batch = MD5_MAX(err_batch, fabs(b.x - qo.x[i]));
+		err_batch = MD5_MAX(err_batch, fabs(b.w - qo.w[i]));
+
+		bench_rotatep_ref(&r, &a, &r);
+		v3_sub(&r, &r, &o);
+		err_rot = MD5_MAX(err_rot, v3_norm(&r));
+	}
+
+	start = clock();
+	for (p=0; p<passes; p++) {
+		for (i=0; i<n; i++) {
+			quat_t a;
+			v3_t r;
+			quat_fill(&a, q.x[i], q.y[i], q.z[i], q.w[i]);
+			bench_rotatep_ref(&r, &a, v3_make(&r, v.x[i], v.y[i], v.z[i]));
+			vo.x[i] = r.x; vo.y[i] = r.y; vo.z[i] = r.z;
+		}
+	}
+	t_ref = bench_seconds(start);
+
+	start = clock();
+	for (p=0; p<passes; p++) {
+		for (i=0; i<n; i++) {
+			quat_t a;
+			v3_t r;
+			quat_fill(&a, q.x[i], q.y[i], q.z[i], q.w[i]);
+			quat_rotatep(&r, &a, v3_make(&r, v.x[i], v.y[i], v.z[i]));
+			vo.x[i] = r.x; vo.y[i] = r.y; vo.z[i] = r.z;
+		}
+	}
+	t_scalar = bench_seconds(start);
+
+	start = clock();
+	for (p=0; p<passes; p++)
+		quat_rotatep_n(&vo, &q, &v, n);
+	t_batch = bench_seconds(start);
+
+	printf("%d lanes, batch vs scalar max error %g, "
+			"new vs old rotation max error %g\n", GEO_LANES, err_batch, err_rot);
+	i = passes * n;
+	printf("rotate q*v*q^-1 %8.3f ns\n", 1e9 * t_ref / i);
+	printf("rotate scalar   %8.3f ns\n", 1e9 * t_scalar / i);
+	printf("rotate batch    %8.3f ns\n", 1e9 * t_batch / i);
+
+	free(mem);
+	/* rounding only, the vectors are some 100 long. */
+	return err_batch > 1e-3 || err_rot > 1e-3;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* every triangle against every ray, what the bvh replaces. */
+static int bench_bvh_brute(const struct md5mesh *mesh, const float *pos,
+		const struct md5ray *rays, struct md5hit *hits, int n) {
+	int r, i, found=0;
+	struct md5bvh one;
+	struct md5bvhnode node;
+
+	/* a single leaf holding one triangle reuses the bvh intersection. */
+	one.num_nodes = 1;
+	one.num_tris = 1;
+	one.nodes = &node;
+	node.first = 0;
+	node.count = 1;
+	node.box.min.x = node.box.min.y = node.box.min.z = -1e30f;
+	node.box.max.x = node.box.max.y = node.box.max.z = 1e30f;
+	for (r=0; r<n; r++) {
+		struct md5ray ray = rays[r];
+		hits[r].tri = -1;
+		hits[r].t = ray.tmax;
+		for (i=0; i<mesh->num.tris; i++) {
+			struct md5hit hit;
+			one.tris = &mesh->tris[i];
+			one.ids = &i;
+			if (md5bvh_raycast(&one, pos, sizeof(v3_t), &ray, &hit, 1)) {
+				hits[r] = hit;
+				ray.tmax = hit.t;
+			}
+		}
+		if (hits[r].tri >= 0) found++;
+	}
+	return found;
+}
+
+static int bench_bvh(int argc, char **argv) {
+	int f, m, r, nrays, found=0, brute_found=0, mismatch=0, tris=0;
+	double t_refit=0, t_cast=0, t_brute=0;
+	clock_t start;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5vfmt fmt;
+	struct md5bvh *bvh;
+	struct md5ray *rays;
+	struct md5hit *hits, *brute;
+	v3_t **pos;
+
+	nrays = argc > 2 ? atoi(argv[2]) : 256;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	bvh = malloc(sizeof(struct md5bvh) * model.num.meshes);
+	assert(bvh);
+	pos = malloc(sizeof(v3_t *) * model.num.meshes);
+	assert(pos);
+	rays = malloc(sizeof(struct md5ray) * nrays);
+	assert(rays);
+	hits = malloc(sizeof(struct md5hit) * nrays);
+	assert(hits);
+	brute = malloc(sizeof(struct md5hit) * nrays);
+	assert(brute);
+	for (m=0; m<model.num.meshes; m++) {
+		const struct md5mesh *mesh = &model.meshes[m];
+		pos[m] = malloc(sizeof(v3_t) * MD5_MAX(mesh->num.verts, 1));
+		assert(pos[m]);
+		md5model_skin(mesh, model.base, &fmt, pos[m]);
+		md5bvh_build(&bvh[m], mesh, (float *)pos[m], sizeof(v3_t));
+		tris += mesh->num.tris;
+	}
+
+	for (f=0; f<anim.num.frames; f++) {
+		const struct md5bbox *box = &anim.bounds[f];
+		v3_t center;
+
+		v3_add(&center, &box->min, &box->max);
+		center.x *= 0.5f; center.y *= 0.5f; center.z *= 0.5f;
+		for (r=0; r<nrays; r++) {
+			struct md5ray *ray = &rays[r];
+			v3_make(&ray->org, center.x + 200 * bench_rand(),
+					center.y + 200 * bench_rand(), center.z + 200 * bench_rand());
+			v3_make(&ray->dir, center.x + 10 * bench_rand() - ray->org.x,
+					center.y + 10 * bench_rand() - ray->org.y,
+					center.z + 40 * bench_rand() - ray->org.z);
+			ray->tmax = 1e30f;
+		}
+
+		for (m=0; m<model.num.meshes; m++) {
+			const struct md5mesh *mesh = &model.meshes[m];
+			md5model_skin(mesh, anim.joints[f], &fmt, pos[m]);
+
+			start = clock();
+			md5bvh_refit(&bvh[m], (float *)pos[m], sizeof(v3_t));
+			t_refit += bench_seconds(start);
+
+			start = clock();
+			found += md5bvh_raycast(&bvh[m], (float *)pos[m], sizeof(v3_t),
+					rays, hits, nrays);
+			t_cast += bench_seconds(start);
+
+			start = clock();
+			brute_found += bench_bvh_brute(mesh, (float *)pos[m], rays, brute,
+					nrays);
+			t_brute += bench_seconds(start);
+
+			for (r=0; r<nrays; r++)
+				if (hits[r].tri != brute[r].tri && hits[r].t != brute[r].t)
+					mismatch++;
+		}
+	}
+
+	f = anim.num.frames;
+	printf("%d tris, %d rays per frame, %d hits, %d brute force hits, "
+			"%d mismatches\n", tris, nrays, found, brute_found, mismatch);
+	printf("refit %8.3f us/frame\n", 1e6 * t_refit / f);
+	printf("bvh   %8.3f us/frame\n", 1e6 * t_cast / f);
+	printf("brute %8.3f us/frame\n", 1e6 * t_brute / f);
+
+	for (m=0; m<model.num.meshes; m++) {
+		md5bvh_end(&bvh[m]);
+		free(pos[m]);
+	}
+	free(bvh); free(pos); free(rays); free(hits); free(brute);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return mismatch != 0 || found != brute_found;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* poses a clip through a bind, checks it against the clip's own poses. */
+static double bench_retarget_pass(const struct md5bind *bind, int frames,
+		int passes, struct md5joint *out) {
+	int p, f;
+	clock_t start = clock();
+
+	for (p=0; p<passes; p++)
+		for (f=0; f<frames; f++)
+			md5anim_pose(bind, f, out);
+	return bench_seconds(start);
+}
+
+/* same names and parents, by strcmp. */
+static int bench_same_joints(const struct md5jinfo *jinfo, int joints,
+		const struct md5model *model) {
+	int i;
+
+	if (joints != model->num.joints) return 0;
+	for (i=0; i<joints; i++)
+		if (jinfo[i].parent != model->jinfo[i].parent
+				|| strcmp(jinfo[i].name, model->jinfo[i].name))
+			return 0;
+	return 1;
+}
+
+static int bench_retarget(int argc, char **argv) {
+	int f, j, err, same, missing, passes, ret=0;
+	double t, maxd=0;
+	struct md5model model, other;
+	struct md5anim anim, clip;
+	struct md5bind bind;
+	struct md5joint *out;
+
+	passes = argc > 3 ? atoi(argv[3]) : 1000;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+
+	missing = md5anim_bind(&bind, &anim, &model);
+	out = malloc(sizeof(struct md5joint) * MD5_MAX(bind.joints, 1));
+	assert(out);
+	for (f=0; f<anim.num.frames; f++) {
+		md5anim_pose(&bind, f, out);
+		for (j=0; j<bind.joints; j++) {
+			const struct md5joint *a = &out[j], *b = &anim.joints[f][j];
+			maxd = MD5_MAX(maxd, fabs(a->pos.x - b->pos.x));
+			maxd = MD5_MAX(maxd, fabs(a->pos.y - b->pos.y));
+			maxd = MD5_MAX(maxd, fabs(a->pos.z - b->pos.z));
+			maxd = MD5_MAX(maxd, fabs(a->ori.w - b->ori.w));
+			maxd = MD5_MAX(maxd, fabs(a->ori.x - b->ori.x));
+			maxd = MD5_MAX(maxd, fabs(a->ori.y - b->ori.y));
+			maxd = MD5_MAX(maxd, fabs(a->ori.z - b->ori.z));
+		}
+	}
+	t = bench_retarget_pass(&bind, anim.num.frames, passes, out);
+	printf("native  %d joints, %d missing, max diff %g, %8.3f ns/joint\n",
+			bind.joints, missing, maxd,
+			1e9 * t / ((double)passes * anim.num.frames * bind.joints));
+	md5bind_end(&bind);
+	free(out);
+
+	if (argc > 2) {
+		if (bench_load(argv[2], NULL, &other, NULL)) return 1;
+		missing = md5anim_bind(&bind, &anim, &other);
+		out = malloc(sizeof(struct md5joint) * MD5_MAX(bind.joints, 1));
+		assert(out);
+		t = bench_retarget_pass(&bind, anim.num.frames, passes, out);
+		printf("%s %d joints, %d missing, %8.3f ns/joint\n", argv[2],
+				bind.joints, missing,
+				1e9 * t / ((double)passes * anim.num.frames * bind.joints));
+		md5bind_end(&bind);
+		free(out);
+
+		/* the clip loads against other only with the same joints. */
+		same = bench_same_joints(anim.jinfo, anim.num.joints, &other);
+		err = md5anim_load(argv[1], &clip, &other);
+		printf("%s %s the clip, expected %s, %s\n", argv[2],
+				err ? "refuses" : "takes", same ? "takes" : "refuses",
+				md5anim_matches(&anim, &other) ? "matches" : "does not match");
+		if (!err) md5anim_end(&clip);
+		if ((err == 0) != same || md5anim_matches(&anim, &other) != same)
+			ret = 1;
+		md5model_end(&other);
+	}
+
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* parameters swept by "sweep", one at a time around md5gen_defaults. */
+static const struct bench_axis {
+	const char *name;
+	int count;
+	double values[8];
+} bench_axes[] = {
+	{ "joints", 7, { 8, 16, 32, 64, 128, 256, 512 } },
+	{ "depth", 6, { 2, 4, 8, 16, 32, 64 } },
+	{ "verts", 7, { 256, 512, 1024, 2048, 4096, 8192, 16384 } },
+	{ "weights", 6, { 1, 2, 3, 4, 6, 8 } },
+	{ "frames", 7, { 16, 32, 64, 128, 256, 512, 1024 } },
+	{ "animated", 5, { 0, .25, .5, .75, 1 } },
+};
+#define BENCH_NUM_AXES ((int)(sizeof(bench_axes) / sizeof(bench_axes[0])))
+
+static void bench_gen_set(struct md5gen *gen, const char *name, double v) {
+	if (!strcmp(name, "joints")) gen->joints = (int)v;
+	else if (!strcmp(name, "depth")) gen->depth = (int)v;
+	else if (!strcmp(name, "verts")) gen->verts = (int)v;
+	else if (!strcmp(name, "weights")) gen->weights = (int)v;
+	else if (!strcmp(name, "frames")) gen->frames = (int)v;
+	else if (!strcmp(name, "animated")) gen->animated = (float)v;
+}
+
+static int bench_gen(int argc, char **argv) {
+	static const char *args[] = {
+		"joints", "depth", "verts", "weights", "frames", "animated"
+	};
+	char mesh[1024], clip[1024];
+	int i, err;
+	struct md5gen gen;
+	struct md5model model;
+	struct md5anim anim;
+	FILE *out;
+
+	md5gen_defaults(&gen);
+	for (i=1; i<argc && i<=6; i++)
+		bench_gen_set(&gen, args[i-1], atof(argv[i]));
+	if (strlen(argv[0]) + 9 > sizeof(mesh)) return 1;
+	sprintf(mesh, "%s.md5mesh", argv[0]);
+	sprintf(clip, "%s.md5anim", argv[0]);
+
+	if (!(out = fopen(mesh, "w"))) return 1;
+	err = md5gen_mesh(out, &gen);
+	if (fclose(out) || err) return 1;
+	if (!(out = fopen(clip, "w"))) return 1;
+	err = md5gen_anim(out, &gen);
+	if (fclose(out) || err) return 1;
+
+	/* reading them back also checks the clip against the mesh. */
+	if (bench_load(mesh, clip, &model, &anim)) return 1;
+	printf("%s: %d joints, %d verts\n", mesh, model.num.joints,
+			model.meshes[0].num.verts);
+	printf("%s: %d frames\n", clip, anim.num.frames);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return 0;
+}
+
+/* parse, pose and skin times of one generated character. */
+static int bench_sweep_point(const struct md5gen *gen, int passes,
+		double *t) {
+	int p, f, m, err, maxverts=1;
+	clock_t start;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5bind bind;
+	struct md5joint *out;
+	struct md5vfmt fmt;
+	void *buf;
+	FILE *tmp;
+
+	if (!(tmp = tmpfile())) return 1;
+	md5gen_mesh(tmp, gen);
+	rewind(tmp);
+	start = clock();
+	err = md5model_read(tmp, &model);
+	t[0] = bench_seconds(start);
+	fclose(tmp);
+	if (err) return 1;
+
+	if (!(tmp = tmpfile())) return 1;
+	md5gen_anim(tmp, gen);
+	rewind(tmp);
+	start = clock();
+	err = md5anim_read(tmp, &anim, &model);
+	t[1] = bench_seconds(start);
+	fclose(tmp);
+	if (err) {
+		md5model_end(&model);
+		return 1;
+	}
+
+	md5anim_bind(&bind, &anim, &model);
+	out = malloc(sizeof(struct md5joint) * bind.joints);
+	assert(out);
+	start = clock();
+	for (p=0; p<passes; p++)
+		for (f=0; f<anim.num.frames; f++)
+			md5anim_pose(&bind, f, out);
+	t[2] = bench_seconds(start) / ((double)passes * anim.num.frames);
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	for (m=0; m<model.num.meshes; m++)
+		maxverts = MD5_MAX(maxverts, model.meshes[m].num.verts);
+	buf = malloc(md5vfmt_size(&fmt) * maxverts);
+	assert(buf);
+	t[3] = bench_skin_format(&model, &anim, passes, &fmt, buf)
+		/ ((double)passes * anim.num.frames);
+
+	free(buf);
+	free(out);
+	md5bind_end(&bind);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return 0;
+}
+
+static int bench_sweep(int argc, char **argv) {
+	int a, i, passes;
+	struct md5gen gen;
+	double t[4];
+
+	passes = argc > 1 ? atoi(argv[1]) : 10;
+	for (a=0; a<BENCH_NUM_AXES; a++) {
+		const struct bench_axis *axis = &bench_axes[a];
+
+		if (argc > 0 && strcmp(argv[0], "all") && strcmp(argv[0], axis->name))
+			continue;
+		printf("# %-8s %10s %10s %10s %10s\n", axis->name,
+				"mesh ms", "anim ms", "pose us", "skin us");
+		for (i=0; i<axis->count; i++) {
+			md5gen_defaults(&gen);
+			bench_gen_set(&gen, axis->name, axis->values[i]);
+			if (bench_sweep_point(&gen, passes, t)) {
+				fprintf(stderr, "%s %g: generated files do not load\n",
+						axis->name, axis->values[i]);
+				return 1;
+			}
+			printf("%10g %10.3f %10.3f %10.3f %10.3f\n", axis->values[i],
+					1e3 * t[0], 1e3 * t[1], 1e6 * t[2], 1e6 * t[3]);
+		}
+		printf("\n");
+	}
+	return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* instances spread from 0 to 1.2 far, every 8th one four times as
+ * important, each playing the clip from its own offset. with err set it
+ * also measures how far the drawn joints are from the exact pose. */
+static double bench_sched_run(struct md5model *model, struct md5bind *bind,
+		struct md5sched *sched, int n, int ticks, int full, double *err) {
+	int i, k, t, m, count, frames = bind->anim->num.frames;
+	long samples=0;
+	struct md5inst *insts;
+	struct md5joint *skel, *drawn;
+	struct md5vfmt fmt;
+	int *update;
+	void *buf;
+	clock_t start;
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	for (m=0, k=1; m<model->num.meshes; m++)
+		k = MD5_MAX(k, model->meshes[m].num.verts);
+	buf = malloc(md5vfmt_size(&fmt) * k);
+	assert(buf);
+	insts = malloc(sizeof(struct md5inst) * n);
+	assert(insts);
+	update = malloc(sizeof(int) * n);
+	assert(update);
+	skel = malloc(sizeof(struct md5joint) * bind->joints);
+	assert(skel);
+	drawn = malloc(sizeof(struct md5joint) * bind->joints);
+	assert(drawn);
+	for (i=0; i<n; i++) {
+		md5inst_init(&insts[i], bind->joints);
+		insts[i].distance = 1.2 * sched->far * i / n;
+		insts[i].importance = i % 8 ? 1 : 4;
+	}
+	if (err) *err = 0;
+
+	start = clock();
+	for (t=0; t<ticks; t++) {
+		if (full) {
+			for (i=0; i<n; i++) {
+				md5anim_pose(bind, (i * 37 + t) % frames, skel);
+				for (m=0; m<model->num.meshes; m++)
+					md5model_skin(&model->meshes[m], skel, &fmt, buf);
+			}
+			continue;
+		}
+		count = md5sched_tick(sched, insts, n, update);
+		for (k=0; k<count; k++) {
+			i = update[k];
+			md5anim_pose(bind, (i * 37 + insts[i].at) % frames, skel);
+			md5inst_set(&insts[i], skel, sched->tick);
+			for (m=0; m<model->num.meshes; m++)
+				md5model_skin(&model->meshes[m], skel, &fmt, buf);
+		}
+		for (i=0; i<n; i++) {
+			if (insts[i].t1 < 0) continue;
+			md5inst_pose(&insts[i], sched->tick, drawn);
+			if (!err) continue;
+			md5anim_pose(bind, (i * 37 + sched->tick) % frames, skel);
+			for (k=0; k<bind->joints; k++) {
+				v3_t d;
+				v3_sub(&d, &drawn[k].pos, &skel[k].pos);
+				*err += v3_norm(&d);
+			}
+			samples += bind->joints;
+		}
+	}
+	if (err && samples) *err /= samples;
+
+	for (i=0; i<n; i++)
+		md5inst_end(&insts[i]);
+	free(insts); free(update); free(skel); free(drawn); free(buf);
+	return bench_seconds(start);
+}
+
+static int bench_sched(int argc, char **argv) {
+	int n, budget, ticks, interval;
+	double full, t, hold, lerp;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5bind bind;
+	struct md5sched sched;
+
+	n = argc > 2 ? atoi(argv[2]) : 256;
+	budget = argc > 3 ? atoi(argv[3]) : 48;
+	ticks = argc > 4 ? atoi(argv[4]) : 200;
+	interval = argc > 5 ? atoi(argv[5]) : 8;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+	md5anim_bind(&bind, &anim, &model);
+
+	md5sched_init(&sched, 10, 100, interval, budget, MD5_SCHED_HOLD);
+	full = bench_sched_run(&model, &bind, &sched, n, ticks, 1, NULL);
+	md5sched_end(&sched);
+	md5sched_init(&sched, 10, 100, interval, budget, MD5_SCHED_INTERPOLATE);
+	t = bench_sched_run(&model, &bind, &sched, n, ticks, 0, NULL);
+	printf("%d instances, %d ticks, budget %d, intervals 1..%d\n",
+			n, ticks, budget, interval);
+	printf("full      %9.3f us/tick, %d updates/tick\n",
+			1e6 * full / ticks, n);
+	printf("scheduled %9.3f us/tick, %.1f updates/tick, %.1f deferred/tick,"
+			" %.1f%% of the work skipped (%.2fx)\n", 1e6 * t / ticks,
+			(double)sched.stats.updates / ticks,
+			(double)sched.stats.deferred / ticks,
+			100 - 100. * sched.stats.updates / ((double)n * ticks),
+			t > 0 ? full / t : 0);
+	md5sched_end(&sched);
+
+	md5sched_init(&sched, 10, 100, interval, budget, MD5_SCHED_HOLD);
+	bench_sched_run(&model, &bind, &sched, n, ticks, 0, &hold);
+	md5sched_end(&sched);
+	md5sched_init(&sched, 10, 100, interval, budget, MD5_SCHED_INTERPOLATE);
+	bench_sched_run(&model, &bind, &sched, n, ticks, 0, &lerp);
+	md5sched_end(&sched);
+	printf("mean joint error: hold %g, interpolate %g\n", hold, lerp);
+
+	md5bind_end(&bind);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* frames whose baked joints differ from a scalar compose of their locals. */
+static int bench_bake_check(const struct md5bind *bind, struct md5joint *out) {
+	int f, bad=0;
+	const struct md5anim *anim = bind->anim;
+
+	for (f=0; f<anim->num.frames; f++) {
+		md5anim_pose(bind, f, out);
+		bad += !!memcmp(out, anim->joints[f],
+				sizeof(struct md5joint) * anim->num.joints);
+	}
+	return bad;
+}
+
+static int bench_bake(int argc, char **argv) {
+	int p, f, passes, threads, bad;
+	double scalar, batched, threaded;
+	clock_t start;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5bind bind;
+	struct md5joint *out;
+
+	threads = argc > 2 ? atoi(argv[2]) : 4;
+	passes = argc > 3 ? atoi(argv[3]) : 50;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+	md5anim_bind(&bind, &anim, &model);
+	out = malloc(sizeof(struct md5joint) * MD5_MAX(bind.joints, 1));
+	assert(out);
+
+	/* the per frame scalar walk the loader used to do. */
+	start = clock();
+	for (p=0; p<passes; p++)
+		for (f=0; f<anim.num.frames; f++)
+			md5anim_pose(&bind, f, out);
+	scalar = bench_seconds(start);
+
+	start = clock();
+	for (p=0; p<passes; p++)
+		md5anim_bake(&anim, 1);
+	batched = bench_seconds(start);
+	bad = bench_bake_check(&bind, out);
+
+	threaded = bench_now();
+	for (p=0; p<passes; p++)
+		md5anim_bake(&anim, threads);
+	threaded = bench_now() - threaded;
+	bad += bench_bake_check(&bind, out);
+
+	f = passes * anim.num.frames;
+	printf("%d frames of %d joints, %d lanes, %d mismatching frames\n",
+			anim.num.frames, anim.num.joints, GEO_LANES, bad);
+	printf("scalar   %8.3f us/frame\n", 1e6 * scalar / f);
+	printf("batched  %8.3f us/frame (%.2fx)\n", 1e6 * batched / f,
+			batched > 0 ? scalar / batched : 0);
+	printf("%d threads %7.3f us/frame (%.2fx)\n", threads, 1e6 * threaded / f,
+			threaded > 0 ? scalar / threaded : 0);
+
+	free(out);
+	md5bind_end(&bind);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return bad != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* the same volume the plain way, one branch per triangle and edge. */
+static int bench_shadow_ref(const struct md5mesh *mesh, const v3_t *pos,
+		const v3_t *light, unsigned char *facing, int *out) {
+	int i, n=0, far = mesh->num.verts;
+
+	for (i=0; i<mesh->num.tris; i++) {
+		const int *idx = mesh->tris[i].idx;
+		v3_t u, v, c, l;
+
+		v3_sub(&u, &pos[idx[1]], &pos[idx[0]]);
+		v3_sub(&v, &pos[idx[2]], &pos[idx[0]]);
+		v3_cross(&c, &u, &v);
+		v3_sub(&l, light, &pos[idx[0]]);
+		facing[i] = v3_dot(&c, &l) > 0;
+	}
+	for (i=0; i<mesh->adj.edges; i++) {
+		const struct md5edge *e = &mesh->adj.edge[i];
+		int a, b;
+
+		if (e->tri[1] >= 0 && facing[e->tri[0]] == facing[e->tri[1]])
+			continue;
+		if (e->tri[1] < 0 && !facing[e->tri[0]])
+			continue;
+		if (facing[e->tri[0]]) {
+			a = e->v[0]; b = e->v[1];
+		} else {
+			a = e->v[1]; b = e->v[0];
+		}
+		out[n++] = b; out[n++] = a; out[n++] = a + far;
+		out[n++] = b; out[n++] = a + far; out[n++] = b + far;
+	}
+	for (i=0; i<mesh->num.tris; i++) {
+		const int *idx = mesh->tris[i].idx;
+		int a = mesh->adj.weld[idx[0]], b = mesh->adj.weld[idx[1]];
+		int c = mesh->adj.weld[idx[2]];
+
+		if (!facing[i]) continue;
+		out[n++] = a; out[n++] = b; out[n++] = c;
+		out[n++] = c + far; out[n++] = b + far; out[n++] = a + far;
+	}
+	return n;
+}
+
+static int bench_shadow(int argc, char **argv) {
+	int p, f, m, i, passes, max=0, welded=0, edges=0, open=0, tris=0;
+	int bad=0;
+	long sides=0, count=0;
+	double t_fast=0, t_ref=0;
+	clock_t start;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5vfmt fmt;
+	unsigned char *facing;
+	int *out, *ref;
+	v3_t **pos;
+
+	passes = argc > 2 ? atoi(argv[2]) : 10;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	pos = malloc(sizeof(v3_t *) * model.num.meshes);
+	assert(pos);
+	for (m=0; m<model.num.meshes; m++) {
+		const struct md5mesh *mesh = &model.meshes[m];
+
+		pos[m] = malloc(sizeof(v3_t) * MD5_MAX(mesh->num.verts, 1));
+		assert(pos[m]);
+		for (i=0; i<mesh->num.verts; i++)
+			welded += mesh->adj.weld[i] != i;
+		max = MD5_MAX(max, md5shadow_max(mesh, 1));
+		tris = MD5_MAX(tris, mesh->num.tris);
+		edges += mesh->adj.edges;
+		open += mesh->adj.open;
+	}
+	facing = malloc(MD5_MAX(tris, 1));
+	assert(facing);
+	out = malloc(sizeof(int) * MD5_MAX(max, 1));
+	assert(out);
+	ref = malloc(sizeof(int) * MD5_MAX(max, 1));
+	assert(ref);
+
+	for (f=0; f<anim.num.frames; f++) {
+		const struct md5bbox *box = &anim.bounds[f];
+		float a = f * .1f;
+		v3_t light;
+
+		/* circles the model a little above it. */
+		v3_make(&light, (box->min.x + box->max.x) * .5f + 100 * (float)cos(a),
+				(box->min.y + box->max.y) * .5f + 100 * (float)sin(a),
+				box->max.z + 20);
+		for (m=0; m<model.num.meshes; m++) {
+			const struct md5mesh *mesh = &model.meshes[m];
+			int n=0, nref=0;
+
+			md5model_skin(mesh, anim.joints[f], &fmt, pos[m]);
+			start = clock();
+			for (p=0; p<passes; p++) {
+				md5shadow_facing(mesh, (float *)pos[m], sizeof(v3_t), &light,
+						facing);
+				n = md5shadow_volume(mesh, facing, 1, out);
+			}
+			t_fast += bench_seconds(start);
+			start = clock();
+			for (p=0; p<passes; p++)
+				nref = bench_shadow_ref(mesh, pos[m], &light, facing, ref);
+			t_ref += bench_seconds(start);
+
+			bad += n != nref || memcmp(out, ref, sizeof(int) * n);
+			md5shadow_facing(mesh, (float *)pos[m], sizeof(v3_t), &light,
+					facing);
+			sides += md5shadow_volume(mesh, facing, 0, out) / 6;
+			count += n;
+		}
+	}
+
+	f = anim.num.frames;
+	printf("%d edges, %d open, %d seam vertices welded\n", edges, open,
+			welded);
+	printf("%.1f silhouette edges, %.1f indices per frame, %d mismatches\n",
+			(double)sides / f, (double)count / f, bad);
+	printf("batched %8.3f us/frame\n", 1e6 * t_fast / (f * passes));
+	printf("branchy %8.3f us/frame (%.2fx)\n", 1e6 * t_ref / (f * passes),
+			t_ref / MD5_MAX(t_fast, 1e-9));
+
+	for (m=0; m<model.num.meshes; m++)
+		free(pos[m]);
+	free(pos); free(facing); free(out); free(ref);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return bad != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* how far p is outside cap, negative inside. */
+static float bench_capsule_out(const struct md5capsule *cap, const v3_t *p) {
+	v3_t ab, ap, d;
+	float t, len;
+
+	v3_sub(&ab, &cap->b, &cap->a);
+	v3_sub(&ap, p, &cap->a);
+	if ((len = v3_dot(&ab, &ab)) > 0)
+		t = MD5_MAX(MD5_MIN(v3_dot(&ap, &ab) / len, 1), 0);
+	else
+		t = 0;
+	v3_make(&d, ap.x - ab.x*t, ap.y - ab.y*t, ap.z - ab.z*t);
+	return v3_norm(&d) - cap->radius;
+}
+
+/* posing the capsules against skinning the mesh, and how well the ones
+ * fitted to the bind pose still hold their vertices once animated. */
+static int bench_capsule(int argc, char **argv) {
+	int p, f, m, i, j, passes, fitted=0, verts=0, bad_bind=0;
+	long outside=0, checked=0;
+	float worst=0, size;
+	double t_pose, t_skin;
+	clock_t start;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5vfmt fmt;
+	struct md5capsule *caps;
+	v3_t *pos;
+
+	passes = argc > 2 ? atoi(argv[2]) : 10;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	for (m=0; m<model.num.meshes; m++)
+		verts = MD5_MAX(verts, model.meshes[m].num.verts);
+	pos = malloc(sizeof(v3_t) * MD5_MAX(verts, 1));
+	assert(pos);
+	caps = malloc(sizeof(struct md5capsule) * model.num.joints);
+	assert(caps);
+	for (j=0; j<model.num.joints; j++)
+		fitted += model.capsules[j].radius >= 0;
+
+	/* tolerance relative to the size of the first frame. */
+	size = v3_norm(v3_sub(pos, &anim.bounds[0].max, &anim.bounds[0].min));
+
+	md5model_capsules(&model, model.base, caps);
+	for (m=0; m<model.num.meshes; m++) {
+		const struct md5mesh *mesh = &model.meshes[m];
+		md5model_skin(mesh, model.base, &fmt, pos);
+		for (i=0; i<mesh->num.verts; i++)
+			if ((j = md5model_dominant(mesh, i)) >= 0
+					&& bench_capsule_out(&caps[j], &pos[i]) > 1e-4f * size)
+				bad_bind++;
+	}
+
+	start = clock();
+	for (p=0; p<passes; p++)
+		for (f=0; f<anim.num.frames; f++)
+			md5model_capsules(&model, anim.joints[f], caps);
+	t_pose = bench_seconds(start);
+	start = clock();
+	for (p=0; p<passes; p++)
+		for (f=0; f<anim.num.frames; f++)
+			for (m=0; m<model.num.meshes; m++)
+				md5model_skin(&model.meshes[m], anim.joints[f], &fmt, pos);
+	t_skin = bench_seconds(start);
+
+	for (f=0; f<anim.num.frames; f++) {
+		md5model_capsules(&model, anim.joints[f], caps);
+		for (m=0; m<model.num.meshes; m++) {
+			const struct md5mesh *mesh = &model.meshes[m];
+			md5model_skin(mesh, anim.joints[f], &fmt, pos);
+			for (i=0; i<mesh->num.verts; i++) {
+				float out;
+				if ((j = md5model_dominant(mesh, i)) < 0) continue;
+				out = bench_capsule_out(&caps[j], &pos[i]);
+				outside += out > 1e-4f * size;
+				worst = MD5_MAX(worst, out);
+				checked++;
+			}
+		}
+	}
+
+	f = anim.num.frames * passes;
+	printf("%d of %d joints fitted, %d bind pose vertices outside\n", fitted,
+			model.num.joints, bad_bind);
+	printf("animated: %.2f%% of vertices outside, by %.3f at most "
+			"(%.2f%% of the model)\n", 100.0 * outside / MD5_MAX(checked, 1),
+			worst, 100 * worst / size);
+	printf("capsules %8.3f us/frame\n", 1e6 * t_pose / f);
+	printf("skinning %8.3f us/frame (%.1fx)\n", 1e6 * t_skin / f,
+			t_skin / MD5_MAX(t_pose, 1e-9));
+
+	free(pos);
+	free(caps);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return bad_bind != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* how much skinning the seam copies save, checked against the plain
+ * skinner in the bind pose. */
+static int bench_dedup(int argc, char **argv) {
+	int a, m, i, bad=0;
+
+	for (a=0; a<argc; a++) {
+		int verts=0, dups=0, terms=0, saved=0;
+		float err=0;
+		struct md5model model;
+		struct md5vfmt fmt;
+		float *out;
+
+		if (bench_load(argv[a], NULL, &model, NULL)) return 1;
+		fmt.type = MD5_VFMT_F32;
+		fmt.st = 1;
+		fmt.stride = 0;
+		for (m=0; m<model.num.meshes; m++) {
+			struct md5mesh *mesh = &model.meshes[m];
+
+			out = malloc(md5vfmt_size(&fmt) * MD5_MAX(mesh->num.verts, 1));
+			assert(out);
+			md5model_skin(mesh, model.base, &fmt, out);
+			md5model_mkmesh_generic(mesh, model.base);
+			for (i=0; i<mesh->num.verts; i++) {
+				const struct md5vertex *v = &mesh->verts[i];
+				const float *f = &out[5 * i];
+
+				err = MD5_MAX(err, fabs(f[0] - v->pos.x));
+				err = MD5_MAX(err, fabs(f[1] - v->pos.y));
+				err = MD5_MAX(err, fabs(f[2] - v->pos.z));
+				bad += f[3] != v->st.x || f[4] != v->st.y;
+				terms += MD5_MAX(v->count, 0);
+				if (mesh->skin.src[i] != i) {
+					dups++;
+					saved += MD5_MAX(v->count, 0);
+				}
+			}
+			verts += mesh->num.verts;
+			free(out);
+		}
+		bad += err > 1e-4f;
+
+		printf("%s: %d of %d vertices are seam copies, %d of %d weight "
+				"terms (%.1f%%) skipped, max error %g\n", argv[a], dups,
+				verts, saved, terms, 100.0 * saved / MD5_MAX(terms, 1), err);
+		md5model_end(&model);
+	}
+	return bad != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* a file's bytes and where its copy lives. */
+struct bench_file {
+	char path[1024];
+	char *data;
+	long size;
+};
+
+/* what the last reload of each watched file did, and when. */
+struct bench_watch_log {
+	int results, err;
+	double at;
+};
+
+static int bench_file_read(struct bench_file *file, const char *src,
+		const char *dir) {
+	const char *base = strrchr(src, '/');
+	FILE *in;
+
+	snprintf(file->path, sizeof(file->path), "%s/%s", dir,
+			base ? base + 1 : src);
+	if (!(in = fopen(src, "rb"))) return 1;
+	fseek(in, 0, SEEK_END);
+	file->size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	file->data = malloc(MD5_MAX(file->size, 1));
+	assert(file->data);
+	file->size = fread(file->data, 1, file->size, in);
+	fclose(in);
+	return 0;
+}
+
+/* the copy rewritten, keep bytes of it. */
+static int bench_file_write(const struct bench_file *file, long keep) {
+	FILE *out;
+	int err;
+
+	if (!(out = fopen(file->path, "wb"))) return 1;
+	err = fwrite(file->data, 1, keep, out) != (size_t)keep;
+	return fclose(out) | err;
+}
+
+/* bytes the heap has handed out and not had back, 0 where that is not
+ * known. */
+static long bench_heap(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2();
+	return (long)(mi.uordblks + mi.hblkhd);
+#else
+	return 0;
+#endif
+}
+
+static void bench_watch_swapped(struct md5watched *w, int err, void *udata) {
+	struct bench_watch_log *log = udata;
+
+	(void)w;
+	log->results++;
+	log->err = err;
+	log->at = bench_now();
+}
+
+/* plays the clip at about 200 frames a second while its copies are
+ * rewritten: the clip, the mesh, both at once, then a clip cut in half, a
+ * mesh with another skeleton and a mesh cut in half, which must be
+ * refused with the old ones kept. a refused mesh must give back all it
+ * had read, and a cache must not serve what it skinned before a swap. */
+static int bench_watch(int argc, char **argv) {
+	static const char *kinds[] = { "anim", "mesh", "both", "broken anim",
+		"foreign mesh", "broken mesh" };
+	int e, f, edits, bad=0, pending=0, kind=0;
+	int broken=0, stale=0;
+	long heap=0, leaked=0;
+	double edited=0, poll_max=0, poll_sum=0, lat_max=0, lat_sum=0;
+	struct bench_file mesh, clip, foreign;
+	struct md5gen gen;
+	FILE *tmp;
+	struct bench_watch_log mlog, alog;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5async pool;
+	struct md5watch watch;
+	struct md5watched wmesh, wanim;
+	struct md5cache cache;
+	struct md5vfmt fmt;
+	float sink=0;
+
+	edits = argc > 3 ? atoi(argv[3]) : 10;
+	if (bench_file_read(&mesh, argv[0], argv[2])
+			|| bench_file_read(&clip, argv[1], argv[2])
+			|| bench_file_write(&mesh, mesh.size)
+			|| bench_file_write(&clip, clip.size)) {
+		fprintf(stderr, "%s: cannot copy the files there\n", argv[2]);
+		return 1;
+	}
+	if (bench_load(mesh.path, clip.path, &model, &anim)) return 1;
+
+	/* a generated mesh, valid but for other clips. */
+	tmp = tmpfile();
+	assert(tmp);
+	md5gen_defaults(&gen);
+	gen.verts = 64;
+	md5gen_mesh(tmp, &gen);
+	foreign.size = ftell(tmp);
+	foreign.data = malloc(foreign.size);
+	assert(foreign.data);
+	rewind(tmp);
+	foreign.size = fread(foreign.data, 1, foreign.size, tmp);
+	fclose(tmp);
+	strcpy(foreign.path, mesh.path);
+
+	if (md5async_init(&pool, 1) || md5watch_init(&watch, &pool)
+			|| md5watch_model(&watch, &wmesh, mesh.path, &model)
+			|| md5watch_anim(&watch, &wanim, clip.path, &anim, NULL, &wmesh)) {
+		fprintf(stderr, "cannot watch %s\n", argv[2]);
+		return 1;
+	}
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	md5cache_init(&cache, &fmt, 16L << 20);
+	watch.cache = &cache;
+	mlog.results = alog.results = 0;
+	wmesh.swapped = bench_watch_swapped;
+	wmesh.udata = &mlog;
+	wanim.swapped = bench_watch_swapped;
+	wanim.udata = &alog;
+
+	for (f=0, e=0; e < edits || pending; f++) {
+		double start;
+
+		/* the next edit once the last one is settled. */
+		if (!pending && f % 20 == 10) {
+			kind = e++ % 6;
+			md5cache_get(&cache, &model, &anim, 0, 0);
+			mlog.results = alog.results = 0;
+			heap = bench_heap();
+			edited = bench_now();
+			if (kind == 0 || kind == 2) bench_file_write(&clip, clip.size);
+			if (kind == 1 || kind == 2) bench_file_write(&mesh, mesh.size);
+			if (kind == 3) bench_file_write(&clip, clip.size / 2);
+			if (kind == 4) bench_file_write(&foreign, foreign.size);
+			if (kind == 5) bench_file_write(&mesh, mesh.size / 2);
+			pending = kind == 2 ? 2 : 1;
+		}
+
+		start = bench_now();
+		md5watch_poll(&watch);
+		poll_sum += bench_now() - start;
+		poll_max = MD5_MAX(poll_max, bench_now() - start);
+
+		/* playback goes on from whatever is live. */
+		sink += anim.joints[f % anim.num.frames][0].pos.x;
+		usleep(5000);
+
+		if (pending && mlog.results + alog.results >= pending) {
+			int refused = kind == 3 ? alog.err : kind >= 4 ? mlog.err : 0;
+			int ok = kind >= 3 ? refused != 0
+				: (kind == 1 || !alog.err) && (kind == 0 || !mlog.err);
+			double at = MD5_MAX(kind == 0 || kind == 3 ? 0 : mlog.at,
+					kind == 1 || kind >= 4 ? 0 : alog.at);
+
+			printf("%-12s %s after %7.3f ms\n", kinds[kind],
+					kind >= 3 ? (refused ? "refused" : "SWAPPED") :
+					ok ? "swapped" : "FAILED", 1e3 * (at - edited));
+			lat_max = MD5_MAX(lat_max, at - edited);
+			lat_sum += at - edited;
+			bad += !ok;
+			/* anything swapped in is skinned anew. */
+			if (kind < 3) {
+				long misses = cache.stats.misses;
+				md5cache_get(&cache, &model, &anim, 0, 0);
+				stale += cache.stats.misses == misses;
+			}
+			if (kind == 5) {
+				leaked += bench_heap() - heap;
+				broken++;
+			}
+			pending = 0;
+			/* the bad copies mended, not timed. */
+			if (kind == 3) bench_file_write(&clip, clip.size);
+			if (kind >= 4) bench_file_write(&mesh, mesh.size);
+		} else if (pending && f > 10000) {
+			printf("%-12s never settled\n", kinds[kind]);
+			bad++;
+			break;
+		}
+	}
+
+	printf("%ld events, %ld reloads, %ld swaps, %ld mismatched\n",
+			watch.stats.events, watch.stats.reloads, watch.stats.swaps,
+			watch.stats.rejected);
+	printf("latency %.3f ms on average, %.3f at most\n",
+			1e3 * lat_sum / MD5_MAX(edits, 1), 1e3 * lat_max);
+	printf("poll    %.3f us a frame on average, %.3f at most (%g)\n",
+			1e6 * poll_sum / f, 1e6 * poll_max, sink * 0);
+	/* the rest of the process moves the heap by a few KB between two
+	 * samples, a partial zfat that is not freed is some 100 KB. */
+	printf("heap    %ld bytes kept by %d refused meshes\n", leaked, broken);
+	printf("cache   %d stale hits after a swap\n", stale);
+	bad += leaked > 32768L * MD5_MAX(broken, 1);
+	bad += stale;
+
+	md5watch_end(&watch);
+	md5cache_end(&cache);
+	md5async_end(&pool);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	free(mesh.data);
+	free(clip.data);
+	free(foreign.data);
+	return bad != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static double bench_volume(const struct md5bbox *box) {
+	return (double)(box->max.x - box->min.x) * (box->max.y - box->min.y)
+		* (box->max.z - box->min.z);
+}
+
+/* the box from the joints against the one around the skinned vertices,
+ * which it must hold, and the one in the file. */
+static int bench_bounds(int argc, char **argv) {
+	int p, f, m, i, passes, verts=0, missed=0;
+	double t_joints, t_skin, joints_ratio=0, file_ratio=0;
+	clock_t start;
+	struct md5model model;
+	struct md5anim anim;
+	struct md5vfmt fmt;
+	struct md5bbox box, exact;
+	v3_t *pos;
+
+	passes = argc > 2 ? atoi(argv[2]) : 20;
+	if (bench_load(argv[0], argv[1], &model, &anim)) return 1;
+	memset(&exact, 0, sizeof(exact));
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	for (m=0; m<model.num.meshes; m++)
+		verts = MD5_MAX(verts, model.meshes[m].num.verts);
+	pos = malloc(sizeof(v3_t) * MD5_MAX(verts, 1));
+	assert(pos);
+
+	start = clock();
+	for (p=0; p<passes; p++)
+		for (f=0; f<anim.num.frames; f++)
+			md5model_bounds(&model, anim.joints[f], &box);
+	t_joints = bench_seconds(start);
+
+	start = clock();
+	for (p=0; p<passes; p++) {
+		for (f=0; f<anim.num.frames; f++) {
+			for (m=0; m<model.num.meshes; m++) {
+				const struct md5mesh *mesh = &model.meshes[m];
+
+				md5model_skin(mesh, anim.joints[f], &fmt, pos);
+				if (!m) exact.min = exact.max = pos[0];
+				for (i=0; i<mesh->num.verts; i++) {
+					exact.min.x = MD5_MIN(exact.min.x, pos[i].x);
+					exact.min.y = MD5_MIN(exact.min.y, pos[i].y);
+					exact.min.z = MD5_MIN(exact.min.z, pos[i].z);
+					exact.max.x = MD5_MAX(exact.max.x, pos[i].x);
+					exact.max.y = MD5_MAX(exact.max.y, pos[i].y);
+					exact.max.z = MD5_MAX(exact.max.z, pos[i].z);
+				}
+			}
+			if (p) continue;
+
+			md5model_bounds(&model, anim.joints[f], &box);
+			missed += exact.min.x < box.min.x - 1e-3f
+				|| exact.min.y < box.min.y - 1e-3f
+				|| exact.min.z < box.min.z - 1e-3f
+				|| exact.max.x > box.max.x + 1e-3f
+				|| exact.max.y > box.max.y + 1e-3f
+				|| exact.max.z > box.max.z + 1e-3f;
+			joints_ratio += bench_volume(&box) / bench_volume(&exact);
+			file_ratio += bench_volume(&anim.bounds[f]) / bench_volume(&exact);
+		}
+	}
+	t_skin = bench_seconds(start);
+
+	f = anim.num.frames;
+	printf("%d frames, %d not covered\n", f, missed);
+	printf("volume over the skinned box: %.2fx from joints, %.2fx in the file\n",
+			joints_ratio / f, file_ratio / f);
+	printf("joints   %8.3f us/frame\n", 1e6 * t_joints / (f * passes));
+	printf("skinned  %8.3f us/frame (%.1fx)\n", 1e6 * t_skin / (f * passes),
+			t_skin / MD5_MAX(t_joints, 1e-9));
+
+	free(pos);
+	md5anim_end(&anim);
+	md5model_end(&model);
+	return missed != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* every frame of the clip, its local pose, through one buffer and back. */
+static int bench_snap_mode(const struct md5anim *anim, int mode,
+		float pos_step, int passes) {
+	int p, f, j, joints = anim->num.joints, frames = anim->num.frames, bad=0;
+	double t_enc, t_dec, pos_err=0, ori_err=0;
+	size_t bytes=0, at;
+	long n;
+	clock_t start;
+	struct md5snap enc, dec;
+	struct md5joint *out;
+	unsigned char *buf;
+
+	md5snap_init(&enc, joints, mode, pos_step, 1.0f / 32768, anim->local[0]);
+	md5snap_init(&dec, joints, mode, pos_step, 1.0f / 32768, anim->local[0]);
+	buf = malloc(md5snap_max(&enc) * frames);
+	assert(buf);
+	out = malloc(sizeof(struct md5joint) * MD5_MAX(joints, 1));
+	assert(out);
+
+	start = clock();
+	for (p=0; p<passes; p++) {
+		md5snap_reset(&enc, anim->local[0]);
+		for (f=0, at=0; f<frames; f++)
+			at += md5snap_encode(&enc, anim->local[f], buf + at);
+		bytes = at;
+	}
+	t_enc = bench_seconds(start);
+
+	start = clock();
+	for (p=0; p<passes; p++) {
+		md5snap_reset(&dec, anim->local[0]);
+		for (f=0, at=0; f<frames; f++) {
+			if ((n = md5snap_decode(&dec, buf + at, bytes - at, out)) < 0) {
+				bad++;
+				break;
+			}
+			at += n;
+			if (p) continue;
+
+			for (j=0; j<joints; j++) {
+				const struct md5joint *a = &anim->local[f][j], *b = &out[j];
+				double s = a->ori.w*b->ori.w + a->ori.x*b->ori.x
+					+ a->ori.y*b->ori.y + a->ori.z*b->ori.z < 0 ? -1 : 1;
+				/* the chord between them, acos near 1 is all rounding. */
+				double dx = a->ori.x - s * b->ori.x, dy = a->ori.y - s * b->ori.y;
+				double dz = a->ori.z - s * b->ori.z, dw = a->ori.w - s * b->ori.w;
+				double d = sqrt(dx*dx + dy*dy + dz*dz + dw*dw) / 2;
+
+				pos_err = MD5_MAX(pos_err, fabs(a->pos.x - b->pos.x));
+				pos_err = MD5_MAX(pos_err, fabs(a->pos.y - b->pos.y));
+				pos_err = MD5_MAX(pos_err, fabs(a->pos.z - b->pos.z));
+				ori_err = MD5_MAX(ori_err, 4 * asin(MD5_MIN(d, 1.0)));
+			}
+		}
+		bad += at != bytes;
+	}
+	t_dec = bench_seconds(start);
+
+	/* both ends must have landed on the same pose. */
+	bad += memcmp(enc.ref, dec.ref, sizeof(long) * 7 * joints) != 0;
+
+	printf("%-9s %7.1f bytes/pose (%5.1f%%)  encode %6.2f us  decode %6.2f us"
+			"  err %.4f, %.4f deg\n",
+			mode == MD5_SNAP_PREVIOUS ? "previous" : "reference",
+			(double)bytes / frames, 100.0 * bytes / frames
+			/ (sizeof(struct md5joint) * joints),
+			1e6 * t_enc / (frames * passes), 1e6 * t_dec / (frames * passes),
+			pos_err, ori_err * 180 / 3.14159265);
+
+	free(buf);
+	free(out);
+	md5snap_end(&enc);
+	md5snap_end(&dec);
+	return bad;
+}
+
+/* the largest delta five bytes hold, over and over against the previous
+ * snapshot, must saturate rather than keep adding up. */
+static int bench_snap_corrupt(float pos_step) {
+	static const unsigned char in[] = { 1, 1, 0xfe, 0xff, 0xff, 0xff, 0x7f };
+	struct md5snap dec;
+	struct md5joint out;
+	float first=0;
+	int i, bad=0;
+
+	md5snap_init(&dec, 1, MD5_SNAP_PREVIOUS, pos_step, 1.0f / 32768, NULL);
+	for (i=0; i<8; i++) {
+		if (md5snap_decode(&dec, in, sizeof(in), &out) != (long)sizeof(in))
+			bad = 1;
+		if (i == 1) first = out.pos.x;
+	}
+	md5snap_end(&dec);
+	return bad || out.pos.x != first;
+}
+
+/* with no reference pose, a snapshot where nothing changed is the
+ * identity, w negative as the loader has it. */
+static int bench_snap_identity(float pos_step) {
+	static const unsigned char in[] = { 0 };
+	struct md5snap dec;
+	struct md5joint out;
+	int bad;
+
+	md5snap_init(&dec, 1, MD5_SNAP_REFERENCE, pos_step, 1.0f / 32768, NULL);
+	bad = md5snap_decode(&dec, in, sizeof(in), &out) != (long)sizeof(in);
+	md5snap_end(&dec);
+	return bad || out.pos.x != 0 || out.pos.y != 0 || out.pos.z != 0
+		|| out.ori.x != 0 || out.ori.y != 0 || out.ori.z != 0
+		|| out.ori.w != -1;
+}
+
+static int bench_snap(int argc, char **argv) {
+	int err, bad;
+	float pos_step = argc > 1 ? atof(argv[1]) : 1.0f / 256;
+	int passes = argc > 2 ? atoi(argv[2]) : 200;
+	struct md5anim anim;
+
+	if ((err = md5anim_load(argv[0], &anim, NULL))) {
+		fprintf(stderr, "%s: md5anim %d\n", argv[0], err);
+		return 1;
+	}
+	printf("%d joints, %d frames, %lu bytes/pose raw, pos step %g\n",
+			anim.num.joints, anim.num.frames,
+			(unsigned long)(sizeof(struct md5joint) * anim.num.joints),
+			pos_step);
+	bad = bench_snap_mode(&anim, MD5_SNAP_REFERENCE, pos_step, passes);
+	bad += bench_snap_mode(&anim, MD5_SNAP_PREVIOUS, pos_step, passes);
+	if (bad) printf("%d round trips failed\n", bad);
+	if (bench_snap_corrupt(pos_step)) {
+		printf("a corrupt stream ran away\n");
+		bad++;
+	}
+	if (bench_snap_identity(pos_step)) {
+		printf("no reference did not decode to the identity\n");
+		bad++;
+	}
+
+	md5anim_end(&anim);
+	return bad != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#define BENCH_CUTS (64)
+
+/* 1 when the first len bytes of buf load as a mesh, or a clip. */
+static int bench_truncate_loads(const char *buf, long len, int anim) {
+	struct md5model model;
+	struct md5anim clip;
+	FILE *tmp;
+	int err;
+
+	if (!(tmp = tmpfile())) return -1;
+	fwrite(buf, 1, len, tmp);
+	rewind(tmp);
+	if (anim) {
+		if (!(err = md5anim_read(tmp, &clip, NULL))) md5anim_end(&clip);
+	} else {
+		if (!(err = md5model_read(tmp, &model))) md5model_end(&model);
+	}
+	fclose(tmp);
+	return !err;
+}
+
+/* each file must load whole and be refused cut short anywhere before its
+ * trailing blanks, at evenly spaced points and in its last bytes. */
+static int bench_truncate(int argc, char **argv) {
+	int i, k, bad=0;
+
+	for (i=0; i<argc; i++) {
+		const char *ext = strrchr(argv[i], '.');
+		int anim = ext && !strcmp(ext, ".md5anim"), cuts=0, taken=0;
+		long len, end;
+		char *buf;
+		FILE *in;
+
+		if (!(in = fopen(argv[i], "rb"))) {
+			fprintf(stderr, "%s: cannot open\n", argv[i]);
+			return 1;
+		}
+		fseek(in, 0, SEEK_END);
+		len = ftell(in);
+		rewind(in);
+		buf = malloc(MD5_MAX(len, 1));
+		assert(buf);
+		len = (long)fread(buf, 1, len, in);
+		fclose(in);
+
+		for (end=len; end > 0 && (buf[end-1] == ' ' || buf[end-1] == '\t'
+					|| buf[end-1] == '\r' || buf[end-1] == '\n'); end--)
+			;
+		for (k=0; k<BENCH_CUTS + 16; k++) {
+			long at = k < BENCH_CUTS ? end * k / BENCH_CUTS
+				: end - (k - BENCH_CUTS) - 1;
+
+			if (at < 0) continue;
+			cuts++;
+			taken += bench_truncate_loads(buf, at, anim) != 0;
+		}
+		k = bench_truncate_loads(buf, len, anim);
+		printf("%s: %s whole, %d of %d cuts loaded\n", argv[i],
+				k > 0 ? "loads" : "refused", taken, cuts);
+		bad += taken + (k <= 0);
+		free(buf);
+	}
+	return bad != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* a loaded model with clips still loading against it must not be thrown
+ * away by a cancel. a second load keeps the one worker busy so the clip is
+ * still queued when the model is done. */
+static int bench_async(int argc, char **argv) {
+	int r, rounds, refused=0, bad=0;
+	struct md5async pool;
+	struct md5job mjob, block, ajob;
+	struct md5model model, other;
+	struct md5anim anim;
+
+	rounds = argc > 2 ? atoi(argv[2]) : 20;
+	if (md5async_init(&pool, 1)) return 1;
+	for (r=0; r<rounds; r++) {
+		md5job_model(&mjob, argv[0], &model);
+		md5job_model(&block, argv[0], &other);
+		md5job_anim(&ajob, argv[1], &anim, &model, &mjob);
+		md5async_submit(&pool, &mjob, MD5_PRIO_HIGH);
+		md5async_submit(&pool, &block, MD5_PRIO_NORMAL);
+		md5async_submit(&pool, &ajob, MD5_PRIO_LOW);
+
+		while (md5async_state(&pool, &mjob) < MD5_JOB_DONE)
+			usleep(100);
+		if (md5async_cancel(&pool, &mjob))
+			refused++;
+		else /* only once the clip no longer needs it. */
+			bad += md5async_state(&pool, &ajob) < MD5_JOB_DONE;
+
+		md5async_wait(&pool, &block);
+		md5async_wait(&pool, &ajob);
+		md5async_wait(&pool, &mjob);
+		bad += ajob.err != 0 && mjob.state == MD5_JOB_FINISHED;
+		if (!block.err) md5model_end(&other);
+		if (ajob.state == MD5_JOB_FINISHED && !ajob.err) md5anim_end(&anim);
+		if (mjob.state == MD5_JOB_FINISHED && !mjob.err) md5model_end(&model);
+	}
+	md5async_end(&pool);
+
+	printf("%d rounds, %d cancels refused, %d wrong\n", rounds, refused, bad);
+	return bad != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[]) {
+	int i;
+
+	for (i=0; argc > 1 && i<BENCH_NUM_CMDS; i++)
+		if (!strcmp(argv[1], bench_cmds[i].name)
+				&& argc - 2 >= bench_cmds[i].args)
+			return bench_cmds[i].run(argc - 2, argv + 2);
+
+	fprintf(stderr, "usage:\n");
+	for (i=0; i<BENCH_NUM_CMDS; i++)
+		fprintf(stderr, "\t%s %s %s\n", argv[0], bench_cmds[i].name,
+				bench_cmds[i].usage);
+	return 1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* the first mesh's vertices share weights, the second's skip some, so a
+ * copy of the weights one vertex at a time is longer than the source in
+ * one, shorter in the other. */
+static const char bench_md5c_mesh[] =
+	"MD5Version 10\n"
+	"commandline \"\"\n"
+	"numJoints 2\n"
+	"numMeshes 2\n"
+	"joints {\n"
+	"\t\"root\" -1 ( 0 0 0 ) ( 0 0 0 )\n"
+	"\t\"tip\" 0 ( 0 0 4 ) ( 0 0 0 )\n"
+	"}\n"
+	"mesh {\n"
+	"\tshader \"shared\"\n"
+	"\tnumverts 4\n"
+	"\tvert 0 ( 0 0 ) 0 2\n"
+	"\tvert 1 ( 1 0 ) 0 2\n"
+	"\tvert 2 ( 0 1 ) 2 1\n"
+	"\tvert 3 ( 1 1 ) 2 1\n"
+	"\tnumtris 2\n"
+	"\ttri 0 0 1 2\n"
+	"\ttri 1 2 1 3\n"
+	"\tnumweights 3\n"
+	"\tweight 0 0 0.5 ( 1 0 0 )\n"
+	"\tweight 1 1 0.5 ( 0 1 0 )\n"
+	"\tweight 2 1 1 ( 0 0 1 )\n"
+	"}\n"
+	"mesh {\n"
+	"\tshader \"unused\"\n"
+	"\tnumverts 3\n"
+	"\tvert 0 ( 0 0 ) 0 1\n"
+	"\tvert 1 ( 1 0 ) 2 1\n"
+	"\tvert 2 ( 0 1 ) 4 1\n"
+	"\tnumtris 1\n"
+	"\ttri 0 0 1 2\n"
+	"\tnumweights 5\n"
+	"\tweight 0 0 1 ( 1 0 0 )\n"
+	"\tweight 1 0 1 ( 9 9 9 )\n"
+	"\tweight 2 1 1 ( 0 1 0 )\n"
+	"\tweight 3 1 1 ( 8 8 8 )\n"
+	"\tweight 4 1 1 ( 0 0 1 )\n"
+	"}\n";
+
+#define GET(_p, _n) if (fread((_p), sizeof(*(_p)), (_n), in) != (size_t)(_n)) \
+	return 1;
+
+static int bench_md5c_skip(FILE *in) {
+	int len;
+
+	GET(&len, 1);
+	return len < 0 || fseek(in, len, SEEK_CUR);
+}
+
+/* 0 when the md5meshb at in gives every vertex of model the weights its
+ * source did, and ends where the last mesh does. */
+static int bench_md5c_check(FILE *in, const struct md5model *model) {
+	const long vsize = 2 * sizeof(float) + 2 * sizeof(int);
+	const long wsize = 4 * sizeof(float) + sizeof(int);
+	char magic[4];
+	int i, k, m, n[3];
+	long verts, weights;
+	float f[7];
+
+	GET(magic, 4);
+	GET(n, 3);
+	if (memcmp(magic, "MD5M", 4) || n[1] != model->num.joints
+			|| n[2] != model->num.meshes)
+		return 1;
+	for (i=0; i<model->num.joints; i++) {
+		GET(n, 1);
+		GET(f, 7);
+		if (bench_md5c_skip(in)) return 1;
+	}
+	for (m=0; m<model->num.meshes; m++) {
+		const struct md5mesh *mesh = &model->meshes[m];
+
+		GET(n, 3);
+		if (n[0] != mesh->num.verts || n[1] != mesh->num.tris
+				|| n[2] != mesh->num.weights || bench_md5c_skip(in))
+			return 1;
+		verts = ftell(in);
+		weights = verts + vsize * n[0] + 3 * sizeof(int) * n[1];
+		for (i=0; i<mesh->num.verts; i++) {
+			const struct md5vertex *v = &mesh->verts[i];
+			int se[2];
+
+			if (fseek(in, verts + vsize * i, SEEK_SET)) return 1;
+			GET(f, 2);
+			GET(se, 2);
+			if (se[1] != v->count || se[0] < 0 || se[0] + se[1] > n[2])
+				return 1;
+			if (fseek(in, weights + wsize * se[0], SEEK_SET)) return 1;
+			for (k=0; k<v->count; k++) {
+				const struct md5weight *w = &mesh->weights[v->start + k];
+				int joint;
+
+				GET(f, 3);
+				GET(&joint, 1);
+				GET(&f[3], 1);
+				if (f[0] != w->pos.x || f[1] != w->pos.y || f[2] != w->pos.z
+						|| joint != w->joint || f[3] != w->bias)
+					return 1;
+			}
+		}
+		if (fseek(in, weights + wsize * n[2], SEEK_SET)) return 1;
+	}
+	return fgetc(in) != EOF;
+}
+#undef GET
+
+/* compiles a mesh with shared and unused weights, and any others given,
+ * with the md5c binary into scratch, then reads each output back against
+ * its source. */
+static int bench_md5c(int argc, char **argv) {
+	char src[512], out[512], path[1024], cmd[2048];
+	int i, err, bad=0;
+	struct bench_file file;
+	struct md5model model;
+	FILE *in;
+
+	snprintf(src, sizeof(src), "%s/md5c-src", argv[1]);
+	snprintf(out, sizeof(out), "%s/md5c-out", argv[1]);
+	mkdir(src, 0755);
+	snprintf(file.path, sizeof(file.path), "%s/shared.md5mesh", src);
+	file.data = (char *)bench_md5c_mesh;
+	if (bench_file_write(&file, sizeof(bench_md5c_mesh) - 1)) return 1;
+	for (i=2; i<argc; i++) {
+		if (bench_file_read(&file, argv[i], src)) return 1;
+		err = bench_file_write(&file, file.size);
+		free(file.data);
+		if (err) return 1;
+	}
+
+	/* no manifest, everything is compiled again. */
+	snprintf(path, sizeof(path), "%s/md5c.manifest", out);
+	remove(path);
+	snprintf(cmd, sizeof(cmd), "%s %s %s 1 > /dev/null", argv[0], src, out);
+	if (system(cmd)) {
+		fprintf(stderr, "%s failed\n", cmd);
+		return 1;
+	}
+
+	for (i=1; i<argc; i++) {
+		const char *base = i == 1 ? "shared.md5mesh" : strrchr(argv[i], '/');
+
+		if (!base) base = argv[i];
+		else if (base[0] == '/') base++;
+		snprintf(path, sizeof(path), "%s/%s", src, base);
+		if (bench_load(path, NULL, &model, NULL)) return 1;
+		snprintf(path, sizeof(path), "%s/%sb", out, base);
+		if (!(in = fopen(path, "rb"))) {
+			fprintf(stderr, "%s: missing\n", path);
+			md5model_end(&model);
+			return 1;
+		}
+		err = bench_md5c_check(in, &model);
+		fclose(in);
+		printf("%-24s %d meshes %s\n", base, model.num.meshes,
+				err ? "DIFFER" : "match");
+		bad += err;
+		md5model_end(&model);
+	}
+	return bad != 0;
+}
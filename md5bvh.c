@@ -0,0 +1,333 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "md5bvh.h"
+#include "md5lex.h"
+
+#define BVH_POS(_pos, _stride, _v) \
+	((const v3_t *)((const char *)(_pos) + (size_t)(_v) * (_stride)))
+
+/* construction state, centroids and boxes indexed by mesh triangle. */
+struct bvhbuilder {
+	struct md5bvh *bvh;
+	v3_t *centroid;
+	struct md5bbox *box;
+};
+
+static int
+bvh_node(struct bvhbuilder *, int, int);
+static void
+bvh_select(struct bvhbuilder *, int *, int, int, int);
+static void
+bvh_tribox(struct md5bbox *, const struct md5tri *, const float *, size_t);
+static void
+bvh_union(struct md5bbox *, const struct md5bbox *, const struct md5bbox *);
+static int
+bvh_overlaps(const struct md5bbox *, const struct md5bbox *);
+static int
+bvh_slab(const struct md5bbox *, const v3_t *, const v3_t *, float, float *);
+static int
+bvh_tri(const struct md5tri *, const float *, size_t, const struct md5ray *,
+		struct md5hit *);
+
+/* -------------------------------------------------------------------------- */
+
+/* pos is any pose of the mesh, usually the bind pose. */
+int md5bvh_build(struct md5bvh *bvh, const struct md5mesh *mesh,
+		const float *pos, size_t stride) {
+	int i;
+	struct bvhbuilder build;
+
+	bvh->num_tris = mesh->num.tris;
+	bvh->num_nodes = 0;
+	if (!bvh->num_tris) {
+		bvh->nodes = NULL;
+		bvh->tris = NULL;
+		bvh->ids = NULL;
+		return 1;
+	}
+
+	bvh->nodes = malloc(sizeof(struct md5bvhnode) * (2*bvh->num_tris - 1));
+	assert(bvh->nodes);
+	bvh->tris = malloc(sizeof(struct md5tri) * bvh->num_tris);
+	assert(bvh->tris);
+	bvh->ids = malloc(sizeof(int) * bvh->num_tris);
+	assert(bvh->ids);
+	build.centroid = malloc(sizeof(v3_t) * bvh->num_tris);
+	assert(build.centroid);
+	build.box = malloc(sizeof(struct md5bbox) * bvh->num_tris);
+	assert(build.box);
+	build.bvh = bvh;
+
+	for (i=0; i<bvh->num_tris; i++) {
+		struct md5bbox *box = &build.box[i];
+		bvh_tribox(box, &mesh->tris[i], pos, stride);
+		v3_add(&build.centroid[i], &box->min, &box->max);
+		bvh->ids[i] = i;
+	}
+	bvh_node(&build, 0, bvh->num_tris);
+
+	for (i=0; i<bvh->num_tris; i++)
+		bvh->tris[i] = mesh->tris[bvh->ids[i]];
+	free(build.centroid);
+	free(build.box);
+	return 0;
+}
+
+/* children come after their parent, so one backwards sweep is enough. */
+void md5bvh_refit(struct md5bvh *bvh, const float *pos, size_t stride) {
+	int i, k;
+
+	for (i=bvh->num_nodes-1; i>=0; i--) {
+		struct md5bvhnode *node = &bvh->nodes[i];
+
+		if (node->count) {
+			struct md5bbox box;
+			bvh_tribox(&node->box, &bvh->tris[node->first], pos, stride);
+			for (k=1; k<node->count; k++) {
+				bvh_tribox(&box, &bvh->tris[node->first + k], pos, stride);
+				bvh_union(&node->box, &node->box, &box);
+			}
+		} else {
+			bvh_union(&node->box, &bvh->nodes[i+1].box,
+					&bvh->nodes[node->first].box);
+		}
+	}
+}
+
+void md5bvh_end(struct md5bvh *bvh) {
+	free(bvh->nodes);
+	free(bvh->tris);
+	free(bvh->ids);
+}
+
+/* closest hit per ray, returns how many rays hit anything. */
+int md5bvh_raycast(const struct md5bvh *bvh, const float *pos, size_t stride,
+		const struct md5ray *rays, struct md5hit *hits, int n) {
+	int r, found=0;
+
+	for (r=0; r<n; r++) {
+		const struct md5ray *ray = &rays[r];
+		struct md5hit *hit = &hits[r];
+		int stack[MD5_BVH_DEPTH], top=0;
+		float tnear;
+		v3_t inv;
+
+		inv.x = ray->dir.x != 0 ? 1 / ray->dir.x : 1e30f;
+		inv.y = ray->dir.y != 0 ? 1 / ray->dir.y : 1e30f;
+		inv.z = ray->dir.z != 0 ? 1 / ray->dir.z : 1e30f;
+		hit->tri = -1;
+		hit->t = ray->tmax;
+
+		if (bvh->num_nodes) stack[top++] = 0;
+		while (top) {
+			const struct md5bvhnode *node = &bvh->nodes[stack[--top]];
+			float tl, tr;
+			int l, rt, hl, hr;
+
+			if (!bvh_slab(&node->box, &ray->org, &inv, hit->t, &tnear))
+				continue;
+			if (node->count) {
+				int k;
+				for (k=0; k<node->count; k++)
+					if (bvh_tri(&bvh->tris[node->first + k], pos, stride, ray, hit))
+						hit->tri = bvh->ids[node->first + k];
+				continue;
+			}
+
+			/* nearest child is popped first. */
+			l = node - bvh->nodes + 1;
+			rt = node->first;
+			hl = bvh_slab(&bvh->nodes[l].box, &ray->org, &inv, hit->t, &tl);
+			hr = bvh_slab(&bvh->nodes[rt].box, &ray->org, &inv, hit->t, &tr);
+			assert(top + 2 <= MD5_BVH_DEPTH);
+			if (hl && hr) {
+				stack[top++] = tl < tr ? rt : l;
+				stack[top++] = tl < tr ? l : rt;
+			} else if (hl) {
+				stack[top++] = l;
+			} else if (hr) {
+				stack[top++] = rt;
+			}
+		}
+		if (hit->tri >= 0) found++;
+	}
+	return found;
+}
+
+/* triangles whose bounds overlap each box. box i's results are
+ * tris[start[i]..start[i+1]), start has n+1 entries. returns the total,
+ * which may be more than the max that got stored. */
+int md5bvh_overlap(const struct md5bvh *bvh, const float *pos, size_t stride,
+		const struct md5bbox *boxes, int n, int *tris, int max, int *start) {
+	int b, total=0;
+
+	for (b=0; b<n; b++) {
+		const struct md5bbox *q = &boxes[b];
+		int stack[MD5_BVH_DEPTH], top=0;
+
+		start[b] = MD5_MIN(total, max);
+		if (bvh->num_nodes) stack[top++] = 0;
+		while (top) {
+			int i = stack[--top];
+			const struct md5bvhnode *node = &bvh->nodes[i];
+
+			if (!bvh_overlaps(&node->box, q))
+				continue;
+			if (node->count) {
+				int k;
+				for (k=0; k<node->count; k++) {
+					struct md5bbox box;
+					bvh_tribox(&box, &bvh->tris[node->first + k], pos, stride);
+					if (!bvh_overlaps(&box, q)) continue;
+					if (total < max) tris[total] = bvh->ids[node->first + k];
+					total++;
+				}
+				continue;
+			}
+			assert(top + 2 <= MD5_BVH_DEPTH);
+			stack[top++] = node->first;
+			stack[top++] = i + 1;
+		}
+	}
+	start[n] = MD5_MIN(total, max);
+	return total;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* median split on the longest centroid axis. */
+static int bvh_node(struct bvhbuilder *build, int first, int count) {
+	struct md5bvh *bvh = build->bvh;
+	int i, index = bvh->num_nodes++, axis=0;
+	struct md5bvhnode *node = &bvh->nodes[index];
+	struct md5bbox cbox;
+	v3_t ext;
+
+	node->box = build->box[bvh->ids[first]];
+	cbox.min = cbox.max = build->centroid[bvh->ids[first]];
+	for (i=first+1; i<first+count; i++) {
+		const v3_t *c = &build->centroid[bvh->ids[i]];
+		struct md5bbox point;
+
+		bvh_union(&node->box, &node->box, &build->box[bvh->ids[i]]);
+		point.min = point.max = *c;
+		bvh_union(&cbox, &cbox, &point);
+	}
+
+	if (count <= MD5_BVH_LEAF) {
+		node->first = first;
+		node->count = count;
+		return index;
+	}
+
+	v3_sub(&ext, &cbox.max, &cbox.min);
+	if (ext.y > ext.x) axis = 1;
+	if (ext.z > (axis ? ext.y : ext.x)) axis = 2;
+	bvh_select(build, &bvh->ids[first], count, count / 2, axis);
+
+	/* left child is index+1, the node array was sized up front. */
+	node->count = 0;
+	bvh_node(build, first, count / 2);
+	node->first = bvh_node(build, first + count / 2, count - count / 2);
+	return index;
+}
+
+/* quickselect, afterwards ids[k] sits where a full sort would put it. */
+static void bvh_select(struct bvhbuilder *build, int *ids, int n, int k,
+		int axis) {
+	int lo=0, hi=n-1;
+
+	while (lo < hi) {
+		int i=lo, j=hi, tmp;
+		float pivot = ((float *)&build->centroid[ids[(lo + hi) / 2]])[axis];
+
+		while (i <= j) {
+			while (((float *)&build->centroid[ids[i]])[axis] < pivot) i++;
+			while (((float *)&build->centroid[ids[j]])[axis] > pivot) j--;
+			if (i <= j) {
+				tmp = ids[i]; ids[i] = ids[j]; ids[j] = tmp;
+				i++; j--;
+			}
+		}
+		if (k <= j) hi = j;
+		else if (k >= i) lo = i;
+		else break;
+	}
+}
+
+static void bvh_tribox(struct md5bbox *box, const struct md5tri *tri,
+		const float *pos, size_t stride) {
+	const v3_t *a = BVH_POS(pos, stride, tri->idx[0]);
+	const v3_t *b = BVH_POS(pos, stride, tri->idx[1]);
+	const v3_t *c = BVH_POS(pos, stride, tri->idx[2]);
+
+	box->min.x = MD5_MIN(a->x, MD5_MIN(b->x, c->x));
+	box->min.y = MD5_MIN(a->y, MD5_MIN(b->y, c->y));
+	box->min.z = MD5_MIN(a->z, MD5_MIN(b->z, c->z));
+	box->max.x = MD5_MAX(a->x, MD5_MAX(b->x, c->x));
+	box->max.y = MD5_MAX(a->y, MD5_MAX(b->y, c->y));
+	box->max.z = MD5_MAX(a->z, MD5_MAX(b->z, c->z));
+}
+
+static void bvh_union(struct md5bbox *r, const struct md5bbox *a,
+		const struct md5bbox *b) {
+	r->min.x = MD5_MIN(a->min.x, b->min.x);
+	r->min.y = MD5_MIN(a->min.y, b->min.y);
+	r->min.z = MD5_MIN(a->min.z, b->min.z);
+	r->max.x = MD5_MAX(a->max.x, b->max.x);
+	r->max.y = MD5_MAX(a->max.y, b->max.y);
+	r->max.z = MD5_MAX(a->max.z, b->max.z);
+}
+
+static int bvh_overlaps(const struct md5bbox *a, const struct md5bbox *b) {
+	return a->min.x <= b->max.x && a->max.x >= b->min.x
+		&& a->min.y <= b->max.y && a->max.y >= b->min.y
+		&& a->min.z <= b->max.z && a->max.z >= b->min.z;
+}
+
+static int bvh_slab(const struct md5bbox *box, const v3_t *org,
+		const v3_t *inv, float tmax, float *tnear) {
+	float t0, t1, lo=0, hi=tmax;
+
+	t0 = (box->min.x - org->x) * inv->x;
+	t1 = (box->max.x - org->x) * inv->x;
+	lo = MD5_MAX(lo, MD5_MIN(t0, t1)); hi = MD5_MIN(hi, MD5_MAX(t0, t1));
+	t0 = (box->min.y - org->y) * inv->y;
+	t1 = (box->max.y - org->y) * inv->y;
+	lo = MD5_MAX(lo, MD5_MIN(t0, t1)); hi = MD5_MIN(hi, MD5_MAX(t0, t1));
+	t0 = (box->min.z - org->z) * inv->z;
+	t1 = (box->max.z - org->z) * inv->z;
+	lo = MD5_MAX(lo, MD5_MIN(t0, t1)); hi = MD5_MIN(hi, MD5_MAX(t0, t1));
+
+	*tnear = lo;
+	return lo <= hi;
+}
+
+/* moller-trumbore, updates hit when closer than hit->t. */
+static int bvh_tri(const struct md5tri *tri, const float *pos, size_t stride,
+		const struct md5ray *ray, struct md5hit *hit) {
+	const v3_t *a = BVH_POS(pos, stride, tri->idx[0]);
+	v3_t e1, e2, p, s, q;
+	float det, u, v, t;
+
+	v3_sub(&e1, BVH_POS(pos, stride, tri->idx[1]), a);
+	v3_sub(&e2, BVH_POS(pos, stride, tri->idx[2]), a);
+	v3_cross(&p, &ray->dir, &e2);
+	det = v3_dot(&e1, &p);
+	if (det > -1e-12f && det < 1e-12f) return 0;
+
+	v3_sub(&s, &ray->org, a);
+	u = v3_dot(&s, &p) / det;
+	if (u < 0 || u > 1) return 0;
+	v3_cross(&q, &s, &e1);
+	v = v3_dot(&ray->dir, &q) / det;
+	if (v < 0 || u + v > 1) return 0;
+	t = v3_dot(&e2, &q) / det;
+	if (t < 0 || t >= hit->t) return 0;
+
+	hit->t = t;
+	hit->u = u;
+	hit->v = v;
+	return 1;
+}
@@ -0,0 +1,46 @@
+#ifndef MD5BVH_H
+#define MD5BVH_H
+
+#include "md5model.h"
+
+#define MD5_BVH_LEAF (4)
+#define MD5_BVH_DEPTH (64)
+
+/* inner nodes have count 0, their left child follows them and first is
+ * the right child. leaves cover tris[first..first+count). */
+struct md5bvhnode {
+	struct md5bbox box;
+	int first, count;
+};
+
+/* built once over a mesh's triangles, refitted to every skinned pose.
+ * positions are float x, y, z every stride bytes, as md5model_skin writes
+ * them with MD5_VFMT_F32 (or &verts[0].pos with sizeof(md5vertex)). */
+struct md5bvh {
+	int num_nodes, num_tris;
+	struct md5bvhnode *nodes;
+	struct md5tri *tris;   /* triangles in leaf order. */
+	int *ids;              /* their index in the mesh. */
+};
+
+struct md5ray {
+	v3_t org, dir;
+	float tmax;
+};
+
+struct md5hit {
+	int tri;               /* -1 on a miss. */
+	float t, u, v;
+};
+
+int  md5bvh_build(struct md5bvh *, const struct md5mesh *,
+		const float *pos, size_t stride);
+void md5bvh_refit(struct md5bvh *, const float *pos, size_t stride);
+void md5bvh_end(struct md5bvh *);
+
+int  md5bvh_raycast(const struct md5bvh *, const float *pos, size_t stride,
+		const struct md5ray *rays, struct md5hit *hits, int n);
+int  md5bvh_overlap(const struct md5bvh *, const float *pos, size_t stride,
+		const struct md5bbox *boxes, int n, int *tris, int max, int *start);
+
+#endif /* MD5BVH_H */
@@ -0,0 +1,605 @@
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "md5model.h"
+#include "md5anim.h"
+
+/* offline asset compiler. walks a tree of .md5mesh/.md5anim sources, checks
+ * every clip against the meshes of its directory and writes binary
+ * .md5meshb/.md5animb files to the same relative path under outdir. inputs
+ * whose content hash (and, for clips, their directory's meshes' hashes) is
+ * unchanged in outdir's manifest are skipped.
+ *
+ * outputs are native endian, every count an int, every float a float:
+ *   md5meshb: "MD5M" version joints meshes
+ *             joints times: parent pos[3] ori[4] namelen name
+ *             meshes times: verts tris weights shaderlen shader
+ *                           verts times: s t start count
+ *                           tris times: idx[3]
+ *                           weights times: pos[3] joint bias
+ *             weights as the source lists them, start indexes them.
+ *   md5animb: "MD5A" version joints frames
+ *             joints times: parent namelen name
+ *             frames times: bbox min[3] max[3]
+ *             frames times: joints times local pos[3] ori[4]
+ *             frames times: joints times model space pos[3] ori[4] */
+
+#define MD5C_VERSION (2)
+#define MD5C_MANIFEST "md5c.manifest"
+#define MD5C_MAX_PATH (4096)
+
+enum md5c_kind { MD5C_MESH, MD5C_ANIM };
+
+enum md5c_status {
+	MD5C_SKIPPED,
+	MD5C_BUILT,
+	MD5C_FAILED
+};
+
+struct md5c_file {
+	char *path;                 /* relative to the source root. */
+	int kind, dir;              /* dir: index of its directory's first file. */
+	unsigned long hash, dep;    /* content, and meshes it was checked against. */
+	long size;
+
+	int dirty, needed, loaded, status;
+	double seconds;
+	struct md5model model;      /* meshes, while clips need them. */
+};
+
+struct md5c {
+	const char *src, *out;
+	struct md5c_file *files;
+	int num_files, cap_files;
+
+	/* previous manifest, sorted by path. */
+	struct md5c_entry { char *path; unsigned long hash, dep; } *manifest;
+	int num_manifest;
+
+	pthread_mutex_t lock;
+	int next, threads;
+	void (*step)(struct md5c *, struct md5c_file *);
+};
+
+static int
+md5c_walk(struct md5c *, const char *);
+static void
+md5c_add(struct md5c *, const char *, int);
+static int
+md5c_samedir(const struct md5c_file *, const struct md5c_file *);
+static int
+md5c_file_cmp(const void *, const void *);
+static int
+md5c_entry_cmp(const void *, const void *);
+static void
+md5c_run(struct md5c *, void (*)(struct md5c *, struct md5c_file *));
+static void *
+md5c_worker(void *);
+
+static void
+md5c_hash(struct md5c *, struct md5c_file *);
+static void
+md5c_mesh(struct md5c *, struct md5c_file *);
+static void
+md5c_anim(struct md5c *, struct md5c_file *);
+static void
+md5c_report(struct md5c *, struct md5c_file *, const char *);
+
+static int
+md5c_write_mesh(FILE *, const struct md5model *);
+static int
+md5c_write_anim(FILE *, const struct md5anim *);
+static FILE *
+md5c_create(struct md5c *, const struct md5c_file *);
+static void
+md5c_outpath(const struct md5c *, const struct md5c_file *, char *);
+
+static void
+md5c_manifest_read(struct md5c *);
+static int
+md5c_manifest_write(struct md5c *);
+static struct md5c_entry *
+md5c_manifest_find(struct md5c *, const char *);
+
+static double
+md5c_now(void);
+
+/* -------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[]) {
+	int i, j, built=0, skipped=0, failed=0;
+	double start, seconds;
+	long bytes=0;
+	struct md5c c;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <srcdir> <outdir> [threads]\n", argv[0]);
+		return 1;
+	}
+	memset(&c, 0, sizeof(c));
+	c.src = argv[1];
+	c.out = argv[2];
+	c.threads = argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	c.threads = MD5_MAX(c.threads, 1);
+	pthread_mutex_init(&c.lock, NULL);
+
+	start = md5c_now();
+	if (mkdir(c.out, 0777) && errno != EEXIST) {
+		fprintf(stderr, "%s: %s\n", c.out, strerror(errno));
+		return 1;
+	}
+	if (md5c_walk(&c, "")) return 1;
+	/* group every directory's files, meshes first. */
+	qsort(c.files, c.num_files, sizeof(struct md5c_file), md5c_file_cmp);
+	md5c_manifest_read(&c);
+
+	md5c_run(&c, md5c_hash);
+
+	/* a clip depends on every mesh it may be checked against. */
+	for (i=0; i<c.num_files; i++) {
+		struct md5c_file *f = &c.files[i];
+		struct md5c_entry *e;
+
+		f->dir = i > 0 && md5c_samedir(&c.files[i-1], f) ? c.files[i-1].dir : i;
+		if (f->kind == MD5C_ANIM)
+			for (j=f->dir; c.files[j].kind == MD5C_MESH; j++)
+				f->dep = f->dep * 1099511628211UL ^ c.files[j].hash;
+		e = md5c_manifest_find(&c, f->path);
+		f->dirty = !e || e->hash != f->hash || e->dep != f->dep;
+		if (!f->dirty) {
+			char out[MD5C_MAX_PATH];
+			struct stat st;
+			md5c_outpath(&c, f, out);
+			f->dirty = stat(out, &st) != 0;
+		}
+	}
+	/* meshes are loaded when they or any clip next to them changed. */
+	for (i=0; i<c.num_files; i++)
+		if (c.files[i].kind == MD5C_ANIM && c.files[i].dirty)
+			for (j=c.files[i].dir; c.files[j].kind == MD5C_MESH; j++)
+				c.files[j].needed = 1;
+
+	md5c_run(&c, md5c_mesh);
+	md5c_run(&c, md5c_anim);
+
+	for (i=0; i<c.num_files; i++) {
+		struct md5c_file *f = &c.files[i];
+		if (f->loaded)
+			md5model_end(&f->model);
+		if (f->status == MD5C_BUILT) {
+			built++;
+			bytes += f->size;
+		} else if (f->status == MD5C_SKIPPED) {
+			skipped++;
+		} else {
+			failed++;
+		}
+	}
+	if (md5c_manifest_write(&c))
+		fprintf(stderr, "%s/%s: %s\n", c.out, MD5C_MANIFEST, strerror(errno));
+	seconds = md5c_now() - start;
+
+	printf("%d built, %d skipped, %d failed, %d threads\n",
+			built, skipped, failed, c.threads);
+	printf("%.3f s, %.2f MB/s, %.1f files/s\n", seconds,
+			seconds > 0 ? bytes / seconds / (1024 * 1024) : 0,
+			seconds > 0 ? built / seconds : 0);
+
+	for (i=0; i<c.num_files; i++)
+		free(c.files[i].path);
+	free(c.files);
+	for (i=0; i<c.num_manifest; i++)
+		free(c.manifest[i].path);
+	free(c.manifest);
+	pthread_mutex_destroy(&c.lock);
+	return failed ? 2 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* source tree                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* collects sources under src/rel, rel is "" or ends with '/'. */
+static int md5c_walk(struct md5c *c, const char *rel) {
+	char path[MD5C_MAX_PATH], sub[MD5C_MAX_PATH];
+	DIR *dir;
+	struct dirent *d;
+	struct stat st;
+
+	sprintf(path, "%s/%s", c->src, rel);
+	if (!(dir = opendir(path))) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	while ((d = readdir(dir))) {
+		size_t len = strlen(d->d_name);
+
+		if (d->d_name[0] == '.') continue;
+		if (strlen(c->src) + strlen(rel) + len + 3 > MD5C_MAX_PATH) continue;
+		snprintf(sub, sizeof(sub), "%s%s", rel, d->d_name);
+		snprintf(path, sizeof(path), "%s/%s", c->src, sub);
+		if (stat(path, &st)) continue;
+
+		if (S_ISDIR(st.st_mode)) {
+			strcat(sub, "/");
+			md5c_walk(c, sub);
+		} else if (len > 8 && !strcmp(d->d_name + len - 8, ".md5mesh")) {
+			md5c_add(c, sub, MD5C_MESH);
+		} else if (len > 8 && !strcmp(d->d_name + len - 8, ".md5anim")) {
+			md5c_add(c, sub, MD5C_ANIM);
+		}
+	}
+	closedir(dir);
+	return 0;
+}
+
+static void md5c_add(struct md5c *c, const char *rel, int kind) {
+	struct md5c_file *f;
+
+	if (c->num_files == c->cap_files) {
+		c->cap_files = MD5_MAX(c->cap_files * 2, 64);
+		c->files = realloc(c->files, sizeof(struct md5c_file) * c->cap_files);
+		assert(c->files);
+	}
+	f = &c->files[c->num_files++];
+	memset(f, 0, sizeof(struct md5c_file));
+	f->path = malloc(strlen(rel) + 1);
+	assert(f->path);
+	strcpy(f->path, rel);
+	f->kind = kind;
+	f->dir = -1;
+}
+
+/* length of the directory part of a relative path, slash included. */
+static size_t md5c_dirlen(const char *path) {
+	const char *slash = strrchr(path, '/');
+	return slash ? (size_t)(slash - path + 1) : 0;
+}
+
+static int md5c_samedir(const struct md5c_file *a, const struct md5c_file *b) {
+	size_t len = md5c_dirlen(a->path);
+	return len == md5c_dirlen(b->path) && !strncmp(a->path, b->path, len);
+}
+
+/* by directory, then meshes before clips, then by name. */
+static int md5c_file_cmp(const void *pa, const void *pb) {
+	const struct md5c_file *a = pa, *b = pb;
+	size_t la = md5c_dirlen(a->path), lb = md5c_dirlen(b->path);
+	int d;
+
+	if (la != lb) return la < lb ? -1 : 1;
+	if ((d = strncmp(a->path, b->path, la))) return d;
+	if (a->kind != b->kind) return a->kind - b->kind;
+	return strcmp(a->path, b->path);
+}
+
+/* -------------------------------------------------------------------------- */
+/* parallel steps                                                             */
+/* -------------------------------------------------------------------------- */
+
+/* runs step on every file across the worker threads, returns once all ran. */
+static void md5c_run(struct md5c *c,
+		void (*step)(struct md5c *, struct md5c_file *)) {
+	int i, err;
+	pthread_t *threads;
+
+	c->next = 0;
+	c->step = step;
+	threads = malloc(sizeof(pthread_t) * c->threads);
+	assert(threads);
+	for (i=0; i<c->threads; i++) {
+		err = pthread_create(&threads[i], NULL, md5c_worker, c);
+		assert(!err);
+	}
+	for (i=0; i<c->threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+static void *md5c_worker(void *udata) {
+	struct md5c *c = udata;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&c->lock);
+		i = c->next++;
+		pthread_mutex_unlock(&c->lock);
+		if (i >= c->num_files) break;
+		c->step(c, &c->files[i]);
+	}
+	return NULL;
+}
+
+/* 64 bit fnv-1a of the whole file, seeded with the output version so a
+ * format change rebuilds everything. */
+static void md5c_hash(struct md5c *c, struct md5c_file *f) {
+	char path[MD5C_MAX_PATH], buf[65536];
+	unsigned long h = (14695981039346656037UL ^ MD5C_VERSION) * 1099511628211UL;
+	size_t i, n;
+	FILE *in;
+
+	sprintf(path, "%s/%s", c->src, f->path);
+	f->size = 0;
+	if (!(in = fopen(path, "rb"))) {
+		f->hash = 0;
+		return;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		for (i=0; i<n; i++)
+			h = (h ^ (unsigned char)buf[i]) * 1099511628211UL;
+		f->size += n;
+	}
+	fclose(in);
+	f->hash = h;
+}
+
+static void md5c_mesh(struct md5c *c, struct md5c_file *f) {
+	char path[MD5C_MAX_PATH];
+	double start = md5c_now();
+	int err;
+	FILE *out;
+
+	if (f->kind != MD5C_MESH) return;
+	if (!f->dirty && !f->needed) {
+		f->status = MD5C_SKIPPED;
+		return;
+	}
+
+	sprintf(path, "%s/%s", c->src, f->path);
+	if ((err = md5model_load(path, &f->model))) {
+		f->status = MD5C_FAILED;
+		f->seconds = md5c_now() - start;
+		fprintf(stderr, "%s: md5model %d\n", f->path, err);
+		return;
+	}
+	f->loaded = 1;
+	if (!f->dirty) {
+		f->status = MD5C_SKIPPED;
+		return;
+	}
+	if (!(out = md5c_create(c, f)) || md5c_write_mesh(out, &f->model)) {
+		f->status = MD5C_FAILED;
+		fprintf(stderr, "%s: %s\n", f->path, strerror(errno));
+	} else {
+		f->status = MD5C_BUILT;
+	}
+	if (out && fclose(out)) f->status = MD5C_FAILED;
+	f->seconds = md5c_now() - start;
+	md5c_report(c, f, "mesh");
+}
+
+/* a clip is good when any mesh in its directory accepts it. */
+static void md5c_anim(struct md5c *c, struct md5c_file *f) {
+	char path[MD5C_MAX_PATH];
+	double start = md5c_now();
+	int i, err, ok=0, meshes=0;
+	struct md5anim anim;
+	FILE *out;
+
+	if (f->kind != MD5C_ANIM) return;
+	if (!f->dirty) {
+		f->status = MD5C_SKIPPED;
+		return;
+	}
+
+	sprintf(path, "%s/%s", c->src, f->path);
+	if ((err = md5anim_load(path, &anim, NULL))) {
+		f->status = MD5C_FAILED;
+		f->seconds = md5c_now() - start;
+		fprintf(stderr, "%s: md5anim %d\n", f->path, err);
+		return;
+	}
+	for (i=f->dir; c->files[i].kind == MD5C_MESH; i++) {
+		meshes++;
+		if (c->files[i].loaded && md5anim_matches(&anim, &c->files[i].model))
+			ok = 1;
+	}
+	/* a lone clip is still worth compiling, nothing to check it against. */
+	if (meshes && !ok) {
+		f->status = MD5C_FAILED;
+		fprintf(stderr, "%s: matches no mesh in its directory\n", f->path);
+	} else if (!(out = md5c_create(c, f))) {
+		f->status = MD5C_FAILED;
+		fprintf(stderr, "%s: %s\n", f->path, strerror(errno));
+	} else {
+		f->status = md5c_write_anim(out, &anim) | fclose(out)
+			? MD5C_FAILED : MD5C_BUILT;
+	}
+	md5anim_end(&anim);
+	f->seconds = md5c_now() - start;
+	md5c_report(c, f, "anim");
+}
+
+static void md5c_report(struct md5c *c, struct md5c_file *f,
+		const char *what) {
+	pthread_mutex_lock(&c->lock);
+	printf("%s %8.3f ms %8.2f MB/s %s%s\n", what, 1e3 * f->seconds,
+			f->seconds > 0 ? f->size / f->seconds / (1024 * 1024) : 0,
+			f->path, f->status == MD5C_FAILED ? " FAILED" : "");
+	pthread_mutex_unlock(&c->lock);
+}
+
+/* -------------------------------------------------------------------------- */
+/* outputs                                                                    */
+/* -------------------------------------------------------------------------- */
+
+#define PUT(_p, _n) if (fwrite((_p), sizeof(*(_p)), (_n), out) != (size_t)(_n)) \
+	return 1;
+
+static int md5c_write_string(FILE *out, const char *s) {
+	int len = s ? (int)strlen(s) : 0;
+	PUT(&len, 1);
+	if (len) PUT(s, len);
+	return 0;
+}
+
+static int md5c_write_joint(FILE *out, const struct md5joint *j) {
+	PUT(&j->pos.x, 1); PUT(&j->pos.y, 1); PUT(&j->pos.z, 1);
+	PUT(&j->ori.w, 1); PUT(&j->ori.x, 1); PUT(&j->ori.y, 1); PUT(&j->ori.z, 1);
+	return 0;
+}
+
+static int md5c_write_mesh(FILE *out, const struct md5model *model) {
+	int i, m, version = MD5C_VERSION;
+
+	PUT("MD5M", 4);
+	PUT(&version, 1);
+	PUT(&model->num.joints, 1);
+	PUT(&model->num.meshes, 1);
+	for (i=0; i<model->num.joints; i++) {
+		PUT(&model->jinfo[i].parent, 1);
+		if (md5c_write_joint(out, &model->base[i])) return 1;
+		if (md5c_write_string(out, model->jinfo[i].name)) return 1;
+	}
+	for (m=0; m<model->num.meshes; m++) {
+		const struct md5mesh *mesh = &model->meshes[m];
+
+		PUT(&mesh->num.verts, 1);
+		PUT(&mesh->num.tris, 1);
+		PUT(&mesh->num.weights, 1);
+		if (md5c_write_string(out, mesh->shader)) return 1;
+		for (i=0; i<mesh->num.verts; i++) {
+			PUT(&mesh->verts[i].st.x, 1);
+			PUT(&mesh->verts[i].st.y, 1);
+			PUT(&mesh->verts[i].start, 1);
+			PUT(&mesh->verts[i].count, 1);
+		}
+		for (i=0; i<mesh->num.tris; i++)
+			PUT(mesh->tris[i].idx, 3);
+		for (i=0; i<mesh->num.weights; i++) {
+			const struct md5weight *w = &mesh->weights[i];
+			PUT(&w->pos.x, 1); PUT(&w->pos.y, 1); PUT(&w->pos.z, 1);
+			PUT(&w->joint, 1);
+			PUT(&w->bias, 1);
+		}
+	}
+	return 0;
+}
+
+static int md5c_write_anim(FILE *out, const struct md5anim *anim) {
+	int i, f, version = MD5C_VERSION;
+
+	PUT("MD5A", 4);
+	PUT(&version, 1);
+	PUT(&anim->num.joints, 1);
+	PUT(&anim->num.frames, 1);
+	for (i=0; i<anim->num.joints; i++) {
+		PUT(&anim->jinfo[i].parent, 1);
+		if (md5c_write_string(out, anim->jinfo[i].name)) return 1;
+	}
+	for (f=0; f<anim->num.frames; f++) {
+		const struct md5bbox *b = &anim->bounds[f];
+		PUT(&b->min.x, 1); PUT(&b->min.y, 1); PUT(&b->min.z, 1);
+		PUT(&b->max.x, 1); PUT(&b->max.y, 1); PUT(&b->max.z, 1);
+	}
+	for (f=0; f<anim->num.frames; f++)
+		for (i=0; i<anim->num.joints; i++)
+			if (md5c_write_joint(out, &anim->local[f][i])) return 1;
+	for (f=0; f<anim->num.frames; f++)
+		for (i=0; i<anim->num.joints; i++)
+			if (md5c_write_joint(out, &anim->joints[f][i])) return 1;
+	return 0;
+}
+#undef PUT
+
+static void md5c_outpath(const struct md5c *c, const struct md5c_file *f,
+		char *path) {
+	sprintf(path, "%s/%sb", c->out, f->path);
+}
+
+/* opens the output for writing, making its directories as needed. */
+static FILE *md5c_create(struct md5c *c, const struct md5c_file *f) {
+	char path[MD5C_MAX_PATH];
+	size_t i, base = strlen(c->out) + 1;
+
+	md5c_outpath(c, f, path);
+	for (i=base; path[i]; i++) {
+		if (path[i] != '/') continue;
+		path[i] = '\0';
+		/* racing workers may make it first. */
+		if (mkdir(path, 0777) && errno != EEXIST) return NULL;
+		path[i] = '/';
+	}
+	return fopen(path, "wb");
+}
+
+/* -------------------------------------------------------------------------- */
+/* manifest, one "hash dep path" line per compiled source.                    */
+/* -------------------------------------------------------------------------- */
+
+static void md5c_manifest_read(struct md5c *c) {
+	char path[MD5C_MAX_PATH], rel[MD5C_MAX_PATH];
+	int cap=0;
+	unsigned long hash, dep;
+	FILE *in;
+
+	sprintf(path, "%s/%s", c->out, MD5C_MANIFEST);
+	if (!(in = fopen(path, "r"))) return;
+	while (fscanf(in, "%lx %lx %4095s", &hash, &dep, rel) == 3) {
+		struct md5c_entry *e;
+
+		if (c->num_manifest == cap) {
+			cap = MD5_MAX(cap * 2, 64);
+			c->manifest = realloc(c->manifest, sizeof(struct md5c_entry) * cap);
+			assert(c->manifest);
+		}
+		e = &c->manifest[c->num_manifest++];
+		e->path = malloc(strlen(rel) + 1);
+		assert(e->path);
+		strcpy(e->path, rel);
+		e->hash = hash;
+		e->dep = dep;
+	}
+	fclose(in);
+	qsort(c->manifest, c->num_manifest, sizeof(struct md5c_entry),
+			md5c_entry_cmp);
+}
+
+static int md5c_entry_cmp(const void *pa, const void *pb) {
+	return strcmp(((const struct md5c_entry *)pa)->path,
+			((const struct md5c_entry *)pb)->path);
+}
+
+static struct md5c_entry *md5c_manifest_find(struct md5c *c,
+		const char *rel) {
+	struct md5c_entry key;
+
+	if (!c->num_manifest) return NULL;
+	key.path = (char *)rel;
+	return bsearch(&key, c->manifest, c->num_manifest,
+			sizeof(struct md5c_entry), md5c_entry_cmp);
+}
+
+/* failed sources are left out so the next run retries them. */
+static int md5c_manifest_write(struct md5c *c) {
+	char path[MD5C_MAX_PATH];
+	int i;
+	FILE *out;
+
+	sprintf(path, "%s/%s", c->out, MD5C_MANIFEST);
+	if (!(out = fopen(path, "w"))) return 1;
+	for (i=0; i<c->num_files; i++) {
+		const struct md5c_file *f = &c->files[i];
+		if (f->status == MD5C_FAILED || strchr(f->path, ' ')) continue;
+		fprintf(out, "%016lx %016lx %s\n", f->hash, f->dep, f->path);
+	}
+	return fclose(out);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static double md5c_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
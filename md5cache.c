@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "md5cache.h"
+
+static unsigned
+md5cache_hash(const struct md5anim *, int, int);
+static struct md5cache_entry **
+md5cache_find(struct md5cache *, const struct md5model *,
+		const struct md5anim *, int, int);
+static void
+md5cache_unlink(struct md5cache *, struct md5cache_entry *);
+static void
+md5cache_touch(struct md5cache *, struct md5cache_entry *);
+static int
+md5cache_evict(struct md5cache *, size_t);
+
+/* -------------------------------------------------------------------------- */
+
+void md5cache_init(struct md5cache *cache, const struct md5vfmt *fmt,
+		size_t budget) {
+	int i;
+
+	cache->fmt = *fmt;
+	cache->fmt.stride = 0; /* entries are always tightly packed. */
+	cache->budget = budget;
+	cache->used = 0;
+	for (i=0; i<MD5_CACHE_BUCKETS; i++)
+		cache->table[i] = NULL;
+	cache->newest = cache->oldest = NULL;
+	cache->stats.hits = cache->stats.misses = cache->stats.evictions = 0;
+}
+
+void md5cache_end(struct md5cache *cache) {
+	struct md5cache_entry *e, *older;
+
+	for (e = cache->newest; e; e = older) {
+		older = e->older;
+		free(e->verts);
+		free(e);
+	}
+	md5cache_init(cache, &cache->fmt, cache->budget);
+}
+
+/* skinned vertices for (model, anim, frame, mesh), skinning them on a miss.
+ * NULL when a single frame does not fit the budget, skin it yourself then.
+ * a miss may evict any entry, so the pointer only holds until the next
+ * md5cache_get, md5cache_bake, md5cache_drop, md5cache_invalidate or
+ * md5cache_end. */
+const void *md5cache_get(struct md5cache *cache,
+		const struct md5model *model, const struct md5anim *anim,
+		int frame, int mesh) {
+	struct md5cache_entry **slot, *e;
+	const struct md5mesh *m = &model->meshes[mesh];
+	size_t size = md5vfmt_size(&cache->fmt) * MD5_MAX(m->num.verts, 1);
+
+	slot = md5cache_find(cache, model, anim, frame, mesh);
+	if ((e = *slot)) {
+		cache->stats.hits++;
+		md5cache_touch(cache, e);
+		return e->verts;
+	}
+
+	cache->stats.misses++;
+	if (md5cache_evict(cache, size)) return NULL;
+	/* eviction may have emptied our chain, look again. */
+	slot = md5cache_find(cache, model, anim, frame, mesh);
+
+	e = malloc(sizeof(struct md5cache_entry));
+	assert(e);
+	e->verts = malloc(size);
+	assert(e->verts);
+	e->model = model;
+	e->anim = anim;
+	e->frame = frame;
+	e->mesh = mesh;
+	e->size = size;
+	e->next = NULL;
+	e->newer = e->older = NULL;
+	*slot = e;
+	md5cache_touch(cache, e);
+	cache->used += size;
+
+	cache->fmt.bounds = anim->bounds[frame];
+	md5model_skin(m, anim->joints[frame], &cache->fmt, e->verts);
+	return e->verts;
+}
+
+/* fills the clip up front into what the budget has left, without evicting
+ * anything, and returns how many frames from the first are resident. it
+ * stops at the first frame that does not fit, so a clip never pushes out
+ * its own earlier frames. md5cache_drop other clips first to make room. */
+int md5cache_bake(struct md5cache *cache, const struct md5model *model,
+		const struct md5anim *anim) {
+	int f, m, baked=0;
+	size_t size, need, vsize = md5vfmt_size(&cache->fmt);
+
+	for (f=0; f<anim->num.frames; f++) {
+		for (m=0, need=0; m<model->num.meshes; m++) {
+			size = vsize * MD5_MAX(model->meshes[m].num.verts, 1);
+			if (!*md5cache_find(cache, model, anim, f, m)) need += size;
+		}
+		if (cache->used + need > cache->budget) break;
+		for (m=0; m<model->num.meshes; m++)
+			md5cache_get(cache, model, anim, f, m);
+		baked++;
+	}
+	return baked;
+}
+
+/* forgets every frame of anim, call it before unloading a clip. */
+void md5cache_drop(struct md5cache *cache, const struct md5anim *anim) {
+	md5cache_invalidate(cache, NULL, anim);
+}
+
+/* forgets every entry skinned from model or from anim, either may be NULL.
+ * entries are keyed on the pointers, so call it whenever one is reloaded
+ * in place. */
+void md5cache_invalidate(struct md5cache *cache, const struct md5model *model,
+		const struct md5anim *anim) {
+	int i;
+	struct md5cache_entry **slot, *e;
+
+	for (i=0; i<MD5_CACHE_BUCKETS; i++) {
+		for (slot = &cache->table[i]; (e = *slot);) {
+			if ((!model || e->model != model) && (!anim || e->anim != anim)) {
+				slot = &e->next;
+				continue;
+			}
+			*slot = e->next;
+			md5cache_unlink(cache, e);
+			cache->used -= e->size;
+			free(e->verts);
+			free(e);
+		}
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+
+static unsigned md5cache_hash(const struct md5anim *anim, int frame, int mesh) {
+	unsigned long h = (unsigned long)anim >> 4;
+
+	h = h * 2654435761UL + (unsigned)frame;
+	h = h * 2654435761UL + (unsigned)mesh;
+	return (unsigned)(h ^ (h >> 15)) & (MD5_CACHE_BUCKETS - 1);
+}
+
+static struct md5cache_entry **md5cache_find(struct md5cache *cache,
+		const struct md5model *model, const struct md5anim *anim,
+		int frame, int mesh) {
+	struct md5cache_entry **slot;
+
+	slot = &cache->table[md5cache_hash(anim, frame, mesh)];
+	for (; *slot; slot = &(*slot)->next) {
+		const struct md5cache_entry *e = *slot;
+		if (e->anim == anim && e->model == model
+				&& e->frame == frame && e->mesh == mesh)
+			break;
+	}
+	return slot;
+}
+
+static void md5cache_unlink(struct md5cache *cache, struct md5cache_entry *e) {
+	if (e->newer) e->newer->older = e->older;
+	else if (cache->newest == e) cache->newest = e->older;
+	if (e->older) e->older->newer = e->newer;
+	else if (cache->oldest == e) cache->oldest = e->newer;
+	e->newer = e->older = NULL;
+}
+
+static void md5cache_touch(struct md5cache *cache, struct md5cache_entry *e) {
+	md5cache_unlink(cache, e);
+	e->older = cache->newest;
+	if (cache->newest) cache->newest->newer = e;
+	cache->newest = e;
+	if (!cache->oldest) cache->oldest = e;
+}
+
+/* drops least recently used entries until size fits, 1 if it never will. */
+static int md5cache_evict(struct md5cache *cache, size_t size) {
+	struct md5cache_entry **slot, *e;
+
+	if (size > cache->budget) return 1;
+	while (cache->used + size > cache->budget && (e = cache->oldest)) {
+		slot = md5cache_find(cache, e->model, e->anim, e->frame, e->mesh);
+		*slot = e->next;
+		md5cache_unlink(cache, e);
+		cache->used -= e->size;
+		cache->stats.evictions++;
+		free(e->verts);
+		free(e);
+	}
+	return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef MD5CACHE_H
+#define MD5CACHE_H
+
+#include "md5model.h"
+#include "md5anim.h"
+
+#define MD5_CACHE_BUCKETS (1024)
+
+/* skinned vertices of one mesh at one frame of a clip. */
+struct md5cache_entry {
+	const struct md5model *model;
+	const struct md5anim *anim;
+	int frame, mesh;
+
+	void *verts;
+	size_t size;
+
+	struct md5cache_entry *next;            /* hash chain. */
+	struct md5cache_entry *newer, *older;   /* lru list. */
+};
+
+/* single threaded. entries use fmt, SNORM16 entries are relative to the
+ * clip's bounds for that frame. */
+struct md5cache {
+	struct md5vfmt fmt;
+	size_t budget, used;
+
+	struct md5cache_entry *table[MD5_CACHE_BUCKETS];
+	struct md5cache_entry *newest, *oldest;
+	struct { long hits, misses, evictions; } stats;
+};
+
+void
+md5cache_init(struct md5cache *, const struct md5vfmt *, size_t budget);
+void
+md5cache_end(struct md5cache *);
+const void *
+md5cache_get(struct md5cache *, const struct md5model *,
+		const struct md5anim *, int frame, int mesh);
+int
+md5cache_bake(struct md5cache *, const struct md5model *,
+		const struct md5anim *);
+void
+md5cache_drop(struct md5cache *, const struct md5anim *);
+void
+md5cache_invalidate(struct md5cache *, const struct md5model *,
+		const struct md5anim *);
+
+#endif /* MD5CACHE_H */
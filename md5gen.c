@@ -0,0 +1,317 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "md5gen.h"
+#include "md5model.h"
+#include "md5lex.h"
+
+/* skeleton shared by a generated mesh and its clips. */
+struct md5gen_skel {
+	int joints;
+	int *parent;
+	struct md5joint *local, *model;
+};
+
+static float
+md5gen_rand(unsigned long *);
+static void
+md5gen_skel(struct md5gen_skel *, const struct md5gen *, unsigned long *);
+static void
+md5gen_skel_end(struct md5gen_skel *);
+static void
+md5gen_compose(const struct md5gen_skel *, const struct md5joint *,
+		struct md5joint *);
+static void
+md5gen_canon(quat_t *);
+static void
+md5gen_frame(const struct md5gen_skel *, const int *, const float *, int,
+		struct md5joint *);
+
+/* -------------------------------------------------------------------------- */
+
+void md5gen_defaults(struct md5gen *gen) {
+	gen->joints = 64;
+	gen->depth = 8;
+	gen->meshes = 1;
+	gen->verts = 2048;
+	gen->weights = 4;
+	gen->frames = 64;
+	gen->animated = 0.5;
+	gen->seed = 1;
+}
+
+/* every vertex sits near one joint and is weighted by it and the following
+ * ones, each weight placed so that they all agree on the bind position. */
+int md5gen_mesh(FILE *out, const struct md5gen *gen) {
+	int i, j, k, m, weights;
+	unsigned long rng = gen->seed;
+	struct md5gen_skel skel;
+	float *bias;
+
+	md5gen_skel(&skel, gen, &rng);
+	weights = MD5_MAX(MD5_MIN(gen->weights, skel.joints), 1);
+	bias = malloc(sizeof(float) * weights);
+	assert(bias);
+
+	fprintf(out, "MD5Version 10\ncommandline \"md5gen\"\n\n");
+	fprintf(out, "numJoints %d\nnumMeshes %d\n\njoints {\n",
+			skel.joints, gen->meshes);
+	for (j=0; j<skel.joints; j++) {
+		const struct md5joint *b = &skel.model[j];
+		fprintf(out, "\t\"joint%d\"\t%d ( %.9g %.9g %.9g ) ( %.9g %.9g %.9g )\n",
+				j, skel.parent[j], b->pos.x, b->pos.y, b->pos.z,
+				b->ori.x, b->ori.y, b->ori.z);
+	}
+	fprintf(out, "}\n");
+
+	for (m=0; m<gen->meshes; m++) {
+		int verts = MD5_MAX(gen->verts, 3);
+
+		fprintf(out, "\nmesh {\n\tshader \"md5gen/%d\"\n\n", m);
+		fprintf(out, "\tnumverts %d\n", verts);
+		for (i=0; i<verts; i++)
+			fprintf(out, "\tvert %d ( %.6g %.6g ) %d %d\n", i,
+					md5gen_rand(&rng) * .5 + .5, md5gen_rand(&rng) * .5 + .5,
+					i * weights, weights);
+
+		/* a strip, about as many triangles as vertices. */
+		fprintf(out, "\n\tnumtris %d\n", verts - 2);
+		for (i=0; i<verts-2; i++)
+			fprintf(out, "\ttri %d %d %d %d\n", i, i, i + 1 + (i & 1),
+					i + 2 - (i & 1));
+
+		fprintf(out, "\n\tnumweights %d\n", verts * weights);
+		for (i=0; i<verts; i++) {
+			int home = (int)((md5gen_rand(&rng) * .5 + .5) * skel.joints)
+				% skel.joints;
+			float sum=0;
+			v3_t pos, off;
+
+			v3_make(&off, md5gen_rand(&rng), md5gen_rand(&rng),
+					md5gen_rand(&rng));
+			v3_add(&pos, &skel.model[home].pos, &off);
+			for (k=0; k<weights; k++)
+				sum += bias[k] = md5gen_rand(&rng) * .5 + .75;
+			for (k=0; k<weights; k++) {
+				const struct md5joint *b = &skel.model[(home + k) % skel.joints];
+				quat_t inv;
+				v3_t d, w;
+
+				quat_conjugate(&inv, &b->ori);
+				v3_sub(&d, &pos, &b->pos);
+				quat_rotatep(&w, &inv, &d);
+				fprintf(out, "\tweight %d %d %.9g ( %.9g %.9g %.9g )\n",
+						i * weights + k, (home + k) % skel.joints,
+						bias[k] / sum, w.x, w.y, w.z);
+			}
+		}
+		fprintf(out, "}\n");
+	}
+	free(bias);
+	md5gen_skel_end(&skel);
+	return ferror(out) ? -1 : 0;
+}
+
+/* animated components follow sines around the base pose. */
+int md5gen_anim(FILE *out, const struct md5gen *gen) {
+	int j, f, c, comps, left, count=0, frames = MD5_MAX(gen->frames, 1);
+	unsigned long rng = gen->seed;
+	struct md5gen_skel skel;
+	struct md5joint *local, *pose;
+	int *flags;
+	float *phase;
+
+	md5gen_skel(&skel, gen, &rng);
+	flags = malloc(sizeof(int) * skel.joints);
+	assert(flags);
+	phase = malloc(sizeof(float) * skel.joints * 6);
+	assert(phase);
+	local = malloc(sizeof(struct md5joint) * skel.joints);
+	assert(local);
+	pose = malloc(sizeof(struct md5joint) * skel.joints);
+	assert(pose);
+
+	/* picks exactly the requested share of components, spread at random. */
+	comps = skel.joints * 6;
+	left = (int)(gen->animated * comps + .5);
+	left = MD5_MAX(MD5_MIN(left, comps), 0);
+	for (j=0; j<skel.joints; j++) {
+		flags[j] = 0;
+		for (c=0; c<6; c++, comps--) {
+			phase[j * 6 + c] = md5gen_rand(&rng) * 3.14159265f;
+			if ((md5gen_rand(&rng) * .5 + .5) * comps < left) {
+				flags[j] |= 1 << c;
+				left--;
+				count++;
+			}
+		}
+	}
+
+	fprintf(out, "MD5Version 10\ncommandline \"md5gen\"\n\n");
+	fprintf(out, "numFrames %d\nnumJoints %d\nframeRate 24\n"
+			"numAnimatedComponents %d\n\nhierarchy {\n",
+			frames, skel.joints, count);
+	for (j=0, c=0; j<skel.joints; j++) {
+		fprintf(out, "\t\"joint%d\"\t%d %d %d\n", j, skel.parent[j], flags[j],
+				flags[j] ? c : 0);
+		for (f=0; f<6; f++)
+			c += flags[j] >> f & 1;
+	}
+
+	fprintf(out, "}\n\nbounds {\n");
+	for (f=0; f<frames; f++) {
+		struct md5bbox b;
+
+		md5gen_frame(&skel, flags, phase, f, local);
+		md5gen_compose(&skel, local, pose);
+		b.min = b.max = pose[0].pos;
+		for (j=1; j<skel.joints; j++) {
+			b.min.x = MD5_MIN(b.min.x, pose[j].pos.x);
+			b.min.y = MD5_MIN(b.min.y, pose[j].pos.y);
+			b.min.z = MD5_MIN(b.min.z, pose[j].pos.z);
+			b.max.x = MD5_MAX(b.max.x, pose[j].pos.x);
+			b.max.y = MD5_MAX(b.max.y, pose[j].pos.y);
+			b.max.z = MD5_MAX(b.max.z, pose[j].pos.z);
+		}
+		/* vertices hang up to sqrt(3) off their joint. */
+		fprintf(out, "\t( %.9g %.9g %.9g ) ( %.9g %.9g %.9g )\n",
+				b.min.x - 2, b.min.y - 2, b.min.z - 2,
+				b.max.x + 2, b.max.y + 2, b.max.z + 2);
+	}
+
+	fprintf(out, "}\n\nbaseframe {\n");
+	for (j=0; j<skel.joints; j++) {
+		const struct md5joint *l = &skel.local[j];
+		fprintf(out, "\t( %.9g %.9g %.9g ) ( %.9g %.9g %.9g )\n",
+				l->pos.x, l->pos.y, l->pos.z, l->ori.x, l->ori.y, l->ori.z);
+	}
+	fprintf(out, "}\n");
+
+	for (f=0; f<frames; f++) {
+		md5gen_frame(&skel, flags, phase, f, local);
+		fprintf(out, "\nframe %d {\n", f);
+		for (j=0; j<skel.joints; j++) {
+			const float *p = &local[j].pos.x, *q = &local[j].ori.x;
+
+			if (!flags[j]) continue;
+			fprintf(out, "\t");
+			for (c=0; c<6; c++)
+				if (flags[j] >> c & 1)
+					fprintf(out, " %.9g", c < 3 ? p[c] : q[c - 3]);
+			fprintf(out, "\n");
+		}
+		fprintf(out, "}\n");
+	}
+
+	free(flags);
+	free(phase);
+	free(local);
+	free(pose);
+	md5gen_skel_end(&skel);
+	return ferror(out) ? -1 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* local transforms at frame f, w rebuilt from x, y, z as the loader does. */
+static void md5gen_frame(const struct md5gen_skel *skel, const int *flags,
+		const float *phase, int f, struct md5joint *local) {
+	int j, c;
+
+	for (j=0; j<skel->joints; j++) {
+		float *p = &local[j].pos.x, *q = &local[j].ori.x, n;
+
+		local[j] = skel->local[j];
+		for (c=0; c<6; c++) {
+			float s = sin(phase[j * 6 + c] + f * .2);
+			if (!(flags[j] >> c & 1)) continue;
+			if (c < 3) p[c] += s;
+			else q[c - 3] += .1 * s;
+		}
+		if ((n = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2])) > .999)
+			for (c=0; c<3; c++)
+				q[c] *= .999 / n;
+		quat_calcw(&local[j].ori);
+	}
+}
+
+/* uniform in [-1, 1), a 64 bit lcg so generation never touches rand(). */
+static float md5gen_rand(unsigned long *rng) {
+	*rng = *rng * 6364136223846793005UL + 1442695040888963407UL;
+	return (float)((*rng >> 40) & 0xffffff) / 0x800000 - 1;
+}
+
+/* a chain of depth joints, the rest hung below any joint that keeps the
+ * chain the deepest. */
+static void md5gen_skel(struct md5gen_skel *skel, const struct md5gen *gen,
+		unsigned long *rng) {
+	int j, *level;
+	int depth = MD5_MAX(MD5_MIN(gen->depth, gen->joints), 2);
+
+	skel->joints = MD5_MAX(gen->joints, 1);
+	skel->parent = malloc(sizeof(int) * skel->joints);
+	assert(skel->parent);
+	skel->local = malloc(sizeof(struct md5joint) * skel->joints);
+	assert(skel->local);
+	skel->model = malloc(sizeof(struct md5joint) * skel->joints);
+	assert(skel->model);
+	level = malloc(sizeof(int) * skel->joints);
+	assert(level);
+
+	for (j=0; j<skel->joints; j++) {
+		struct md5joint *l = &skel->local[j];
+		int p = j - 1;
+
+		if (j >= depth) do {
+			p = (int)((md5gen_rand(rng) * .5 + .5) * j) % j;
+		} while (level[p] >= depth);
+		skel->parent[j] = p;
+		level[j] = p < 0 ? 1 : level[p] + 1;
+
+		v3_make(&l->pos, md5gen_rand(rng) * 2, md5gen_rand(rng) * 2,
+				md5gen_rand(rng) * 2 + 3);
+		quat_fill(&l->ori, md5gen_rand(rng) * .3, md5gen_rand(rng) * .3,
+				md5gen_rand(rng) * .3, 1);
+		quat_normalize(&l->ori, &l->ori);
+		md5gen_canon(&l->ori);
+	}
+	free(level);
+	md5gen_compose(skel, skel->local, skel->model);
+}
+
+static void md5gen_skel_end(struct md5gen_skel *skel) {
+	free(skel->parent);
+	free(skel->local);
+	free(skel->model);
+}
+
+static void md5gen_compose(const struct md5gen_skel *skel,
+		const struct md5joint *local, struct md5joint *out) {
+	int j;
+
+	for (j=0; j<skel->joints; j++) {
+		int p = skel->parent[j];
+		v3_t pos;
+
+		if (p < 0) {
+			out[j] = local[j];
+			continue;
+		}
+		quat_rotatep(&pos, &out[p].ori, &local[j].pos);
+		v3_add(&out[j].pos, &pos, &out[p].pos);
+		quat_mulq(&out[j].ori, &out[p].ori, &local[j].ori);
+		quat_normalize(&out[j].ori, &out[j].ori);
+		md5gen_canon(&out[j].ori);
+	}
+}
+
+/* files only keep x, y, z and the loader assumes w <= 0. */
+static void md5gen_canon(quat_t *q) {
+	if (q->w > 0) {
+		q->w = -q->w;
+		q->x = -q->x;
+		q->y = -q->y;
+		q->z = -q->z;
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef MD5GEN_H
+#define MD5GEN_H
+
+#include <stdio.h>
+
+/* a synthetic character. the same parameters (seed included) always give
+ * the same files, and a clip always matches the mesh made from them. */
+struct md5gen {
+	int joints;
+	int depth;        /* longest root to leaf chain, 2 at least. */
+	int meshes;
+	int verts;        /* per mesh. */
+	int weights;      /* per vertex, at most joints. */
+	int frames;
+	float animated;   /* fraction of the 6 components of every joint. */
+	unsigned long seed;
+};
+
+void md5gen_defaults(struct md5gen *);
+int  md5gen_mesh(FILE *, const struct md5gen *);
+int  md5gen_anim(FILE *, const struct md5gen *);
+
+#endif /* MD5GEN_H */
@@ -26,8 +26,7 @@ int md5lex_checktk(FILE *in, char *s) {
 	md5lex_eatcomment(in);
 	while (*s) {
 		c = fgetc(in);
-		if (c == EOF) return 1;
-		if (c != *s++) return 0; /* match failed. */
+		if (c != *s++) return 0; /* match failed, or the file ended. */
 	}
 	return 1;
 }
@@ -45,7 +44,7 @@ int md5lex_readstring(FILE *in, char **sp, size_t *n) {
 	if ((c = fgetc(in)) != '"') { /* not a string! */
 		ungetc(c, in);
 	} else while ((c = fgetc(in)) != EOF) {
-		if (i == sz) s = *sp = realloc(*sp, sz *= 2);
+		if (i + 1 == sz) s = *sp = realloc(*sp, sz *= 2); /* room for '\0'. */
 		if (c == '"') { fail=0; break; }
 		s[i++] = c;
 	}
@@ -60,12 +59,12 @@ int md5lex_readstring(FILE *in, char **sp, size_t *n) {
 
 int md5lex_readint(FILE *in, int *v) {
 	md5lex_eatcomment(in);
-	return fscanf(in, " %d", v);
+	return fscanf(in, " %d", v) == 1;
 }
 
 int md5lex_readfloat(FILE *in, float *f) {
 	md5lex_eatcomment(in);
-	return fscanf(in, " %f", f);
+	return fscanf(in, " %f", f) == 1;
 }
 
 static void md5lex_eatsp(FILE *in) {
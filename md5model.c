@@ -10,7 +10,8 @@
 #define MD5MAX(a, b) ((a) > (b) ? (a) : (b))
 
 static int
-parse_joints(FILE *, struct md5joint *, struct md5jinfo *, int);
+parse_joints(FILE *, struct md5joint *, struct md5jinfo *,
+		struct md5names *, int);
 static int
 parse_meshes(FILE *, struct md5mesh *);
 static int
@@ -19,76 +20,253 @@ static int
 parse_meshes_tri(FILE *, struct md5tri *tris, int);
 static int
 parse_meshes_weight(FILE *, struct md5weight *, int);
+static void
+mesh_dedup(struct md5mesh *);
+static void
+mesh_bucket(struct md5mesh *);
+static void
+mesh_deps(struct md5mesh *);
+static void
+mesh_edges(struct md5mesh *);
+static int
+mesh_half_cmp(const void *, const void *);
+static void
+model_capsules(struct md5model *);
+static void
+model_jbounds(struct md5model *);
+static void
+capsule_fit(struct md5capsule *, const v3_t *, int);
+
+/* where and how the kernels write, resolved once per skinning call. */
+struct skin_out {
+	int type, st;
+	size_t stride;
+	char *dst;
+	v3_t center, scale;
+};
+
+static void
+skin_prepare(struct skin_out *, const struct md5vfmt *, void *);
+static void
+skin_store_st(const struct skin_out *, char *, const v2_t *);
+static void
+skin_copy(const struct skin_out *, const struct md5mesh *, int, int);
+static void
+skin_dups(const struct md5mesh *, const unsigned char *,
+		const struct skin_out *);
+static void
+skin_mesh(const struct md5mesh *, const struct md5joint *,
+		const struct skin_out *);
+
+typedef void (*skin_fn)(const struct md5mesh *, const struct md5joint *,
+		const int *, int, const struct skin_out *);
+static void
+skin_1(const struct md5mesh *, const struct md5joint *,
+		const int *, int, const struct skin_out *);
+static void
+skin_2(const struct md5mesh *, const struct md5joint *,
+		const int *, int, const struct skin_out *);
+static void
+skin_3(const struct md5mesh *, const struct md5joint *,
+		const int *, int, const struct skin_out *);
+static void
+skin_4(const struct md5mesh *, const struct md5joint *,
+		const int *, int, const struct skin_out *);
+static void
+skin_n(const struct md5mesh *, const struct md5joint *,
+		const int *, int, const struct skin_out *);
+
+static const skin_fn skin_kernels[MD5_SKIN_BUCKETS] = {
+	skin_1, skin_2, skin_3, skin_4, skin_n
+};
 
 /* -------------------------------------------------------------------------- */
 
 int md5model_load(const char *fname, struct md5model *model) {
+	int err;
 	FILE *in;
 
 	if (!(in = fopen(fname, "r"))) return -1;
-	if (md5model_read(in, model)) return -2;
+	err = md5model_read(in, model);
 	fclose(in);
 
-	return 0;
+	return err ? -2 : 0;
 }
 
+/* a file that fails part way frees what it had read, model is left as
+ * md5model_end leaves it. */
+#define DONE(_err) { err=_err; goto done; }
 int md5model_read(FILE *in, struct md5model *model) {
 	char *cmdline=NULL;
 	size_t cmdlinesz;
-	int i, ver;
+	int i, ver, err=0;
+
+	memset(model, 0, sizeof(*model));
+	md5names_init(&model->names);
 
 	/* MD5Version <int> */
-	if (!md5lex_checktk(in, "MD5Version")) return 1;
-	if (!md5lex_readint(in, &ver) || ver != 10) return 2;
+	if (!md5lex_checktk(in, "MD5Version")) DONE(1);
+	if (!md5lex_readint(in, &ver) || ver != 10) DONE(2);
 
 	/* commandline "bla bla bla..." */
-	if (!md5lex_checktk(in, "commandline")) return 3;
+	if (!md5lex_checktk(in, "commandline")) DONE(3);
 	md5lex_readstring(in, &cmdline, &cmdlinesz);
 	free(cmdline); cmdline=NULL; /* throw it away. */
 
 	/* numJoints <int> */
-	if (!md5lex_checktk(in, "numJoints")) return 4;
-	md5lex_readint(in, &model->num.joints);
-	assert(model->base = malloc(sizeof(struct md5joint) * model->num.joints));
-	assert(model->jinfo= malloc(sizeof(struct md5jinfo) * model->num.joints));
+	if (!md5lex_checktk(in, "numJoints")) DONE(4);
+	if (!md5lex_readint(in, &model->num.joints) || model->num.joints < 0)
+		DONE(4);
+	model->base = malloc(sizeof(struct md5joint)
+			* MD5MAX(model->num.joints, 1));
+	assert(model->base);
+	model->jinfo = malloc(sizeof(struct md5jinfo)
+			* MD5MAX(model->num.joints, 1));
+	assert(model->jinfo);
 
 	/* numMeshes <int> */
-	if (!md5lex_checktk(in, "numMeshes")) return 5;
-	md5lex_readint(in, &model->num.meshes);
-	assert(model->meshes = malloc(sizeof(struct md5mesh) * model->num.meshes));
+	if (!md5lex_checktk(in, "numMeshes")) DONE(5);
+	if (!md5lex_readint(in, &model->num.meshes) || model->num.meshes < 0)
+		DONE(5);
+	/* zeroed, so md5model_end can free meshes that were never read. */
+	model->meshes = calloc(MD5MAX(model->num.meshes, 1),
+			sizeof(struct md5mesh));
+	assert(model->meshes);
 
 	/* joints */
-	if (!md5lex_checktk(in, "joints")) return 6;
-	if (!md5lex_checktk(in, "{")) return 7;
-	if (parse_joints(in, model->base, model->jinfo, model->num.joints))
-		return 8;
-	if (!md5lex_checktk(in, "}")) return 9;
+	if (!md5lex_checktk(in, "joints")) DONE(6);
+	if (!md5lex_checktk(in, "{")) DONE(7);
+	if (parse_joints(in, model->base, model->jinfo, &model->names,
+				model->num.joints))
+		DONE(8);
+	if (!md5lex_checktk(in, "}")) DONE(9);
 
 	/* meshs */
 	for (i=0; i<model->num.meshes; i++) {
-		if (!md5lex_checktk(in, "mesh")) return 10;
-		if (!md5lex_checktk(in, "{")) return 11;
-		if (parse_meshes(in, &model->meshes[i])) return 12;
-		if (!md5lex_checktk(in, "}")) return 13;
+		if (!md5lex_checktk(in, "mesh")) DONE(10);
+		if (!md5lex_checktk(in, "{")) DONE(11);
+		if (parse_meshes(in, &model->meshes[i])) DONE(12);
+		if (!md5lex_checktk(in, "}")) DONE(13);
+		mesh_edges(&model->meshes[i]);
 	}
-	return 0;
+	model_capsules(model);
+	model_jbounds(model);
+done:
+	if (err) md5model_end(model);
+	return err;
 }
+#undef DONE
 
+/* frees everything model holds. takes a model md5model_read refused or
+ * one already ended, and leaves it zeroed. */
 void md5model_end(struct md5model *model) {
 	int i;
 
-	for(i=0; i<model->num.joints; i++) {
-
-	}
-	for(i=0; i<model->num.meshes; i++) {
+	for(i=0; model->meshes && i<model->num.meshes; i++) {
 		struct md5mesh *mesh = &model->meshes[i];
 		free(mesh->verts);
 		free(mesh->tris);
 		free(mesh->weights);
+		free(mesh->shader);
+		free(mesh->skin.verts);
+		free(mesh->skin.src);
+		free(mesh->deps.jstart);
+		free(mesh->deps.jverts);
+		free(mesh->adj.edge);
+		free(mesh->adj.weld);
 	}
 	free(model->meshes);
+	free(model->capsules);
+	free(model->jbounds);
 	free(model->base);
 	free(model->jinfo);
+	md5names_end(&model->names);
+	memset(model, 0, sizeof(*model));
+	md5names_init(&model->names);
+}
+
+/* joint index by name, -1 when there is no such joint. */
+int md5model_joint(const struct md5model *model, const char *name) {
+	int id = md5names_id(&model->names, name);
+	return id < 0 ? -1 : md5names_value(&model->names, id);
+}
+
+/* the joint with the largest bias on vert, the first one on ties and -1
+ * when vert has no weights. */
+int md5model_dominant(const struct md5mesh *mesh, int vert) {
+	const struct md5vertex *vertex = &mesh->verts[vert];
+	int k, best=-1;
+
+	for (k=vertex->start; k<vertex->start + vertex->count; k++)
+		if (best < 0 || mesh->weights[k].bias > mesh->weights[best].bias)
+			best = k;
+	return best < 0 ? -1 : mesh->weights[best].joint;
+}
+
+/* the fitted capsules moved by skel, one per joint and in O(joints) no
+ * matter how many vertices they cover. */
+void md5model_capsules(const struct md5model *model,
+		const struct md5joint *skel, struct md5capsule *out) {
+	int j;
+
+	for (j=0; j<model->num.joints; j++) {
+		const struct md5capsule *cap = &model->capsules[j];
+		const struct md5joint *joint = &skel[j];
+
+		quat_rotatep(&out[j].a, &joint->ori, &cap->a);
+		v3_add(&out[j].a, &out[j].a, &joint->pos);
+		quat_rotatep(&out[j].b, &joint->ori, &cap->b);
+		v3_add(&out[j].b, &out[j].b, &joint->pos);
+		out[j].radius = cap->radius;
+	}
+}
+
+/* a box around every vertex skel puts the meshes in, from the joints
+ * alone. a vertex is a blend of its weights' positions, so with biases
+ * that sum to one it lies within the boxes its joints carry them in.
+ * each box is moved as center and extent, the extent through |R|.
+ * it works for any pose but is looser than a clip's own boxes: 1.49x the
+ * skinned vertices' box volume on zfat idle1, where the file's are 1.00x.
+ * use those for unblended frames of a clip that has them. */
+void md5model_bounds(const struct md5model *model,
+		const struct md5joint *skel, struct md5bbox *out) {
+	int j, any=0;
+
+	for (j=0; j<model->num.joints; j++) {
+		const struct md5bbox *box = &model->jbounds[j];
+		const quat_t *q = &skel[j].ori;
+		fp_t r[3][3];
+		v3_t c, e, wc, we;
+
+		if (box->min.x > box->max.x) continue;
+		quat_mat3(r, q);
+
+		v3_make(&c, (box->min.x + box->max.x) * .5f,
+				(box->min.y + box->max.y) * .5f, (box->min.z + box->max.z) * .5f);
+		v3_make(&e, (box->max.x - box->min.x) * .5f,
+				(box->max.y - box->min.y) * .5f, (box->max.z - box->min.z) * .5f);
+		quat_rotatep(&wc, q, &c);
+		v3_add(&wc, &wc, &skel[j].pos);
+		we.x = fabs(r[0][0])*e.x + fabs(r[0][1])*e.y + fabs(r[0][2])*e.z;
+		we.y = fabs(r[1][0])*e.x + fabs(r[1][1])*e.y + fabs(r[1][2])*e.z;
+		we.z = fabs(r[2][0])*e.x + fabs(r[2][1])*e.y + fabs(r[2][2])*e.z;
+
+		if (!any++) {
+			v3_sub(&out->min, &wc, &we);
+			v3_add(&out->max, &wc, &we);
+			continue;
+		}
+		out->min.x = MD5MIN(out->min.x, wc.x - we.x);
+		out->min.y = MD5MIN(out->min.y, wc.y - we.y);
+		out->min.z = MD5MIN(out->min.z, wc.z - we.z);
+		out->max.x = MD5MAX(out->max.x, wc.x + we.x);
+		out->max.y = MD5MAX(out->max.y, wc.y + we.y);
+		out->max.z = MD5MAX(out->max.z, wc.z + we.z);
+	}
+	if (!any) {
+		v3_zero(&out->min);
+		v3_zero(&out->max);
+	}
 }
 
 /* -------------------------------------------------------------------------- */
@@ -96,16 +274,23 @@ void md5model_end(struct md5model *model) {
 static int parse_joints(FILE *in,
 		struct md5joint *joint,
 		struct md5jinfo *jinfo,
+		struct md5names *names,
 		int joints) {
 	int i;
+	char *name;
 
 	/* "name" parent ( pos.x pos.y pos.z ) ( orient.x orient.y orient.z ) */
 	for (i=0; i<joints; i++) {
 		struct md5joint *jointi = &joint[i];
 		struct md5jinfo *jinfoi = &jinfo[i];
 
-		jinfoi->name = NULL;
-		if (!md5lex_readstring(in, &jinfoi->name, NULL)) return 1;
+		/* a repeated name keeps resolving to its first joint. */
+		name = NULL;
+		if (!md5lex_readstring(in, &name, NULL)) return 1;
+		jinfoi->id = md5names_intern(names, name, i);
+		jinfoi->name = md5names_str(names, jinfoi->id);
+		jinfoi->shared = md5names_shared(name);
+		free(name);
 		if (!md5lex_readint(in, &jinfoi->parent)) return 2;
 
 		md5lex_checktk(in, "(");
@@ -125,6 +310,75 @@ static int parse_joints(FILE *in,
 }
 
 void md5model_mkmesh(struct md5mesh *mesh, struct md5joint *skel)
+{
+	struct md5vfmt fmt;
+	struct skin_out out;
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = sizeof(struct md5vertex);
+	skin_prepare(&out, &fmt, &mesh->verts[0].pos);
+	skin_mesh(mesh, skel, &out);
+}
+
+void md5model_skin(const struct md5mesh *mesh, const struct md5joint *skel,
+		const struct md5vfmt *fmt, void *dst)
+{
+	struct skin_out out;
+
+	skin_prepare(&out, fmt, dst);
+	skin_mesh(mesh, skel, &out);
+}
+
+/* re-skins only the vertices weighted by a dirty joint, dst must still hold
+ * the previous output. returns how many vertices were skipped. mark and
+ * list are the caller's scratch, num.verts long, as md5pose keeps them. */
+int md5model_skin_dirty(const struct md5mesh *mesh,
+		const struct md5joint *skel, const unsigned char *dirty,
+		unsigned char *mark, int *list, const struct md5vfmt *fmt, void *dst)
+{
+	int b, i, j, n, refs=0;
+	struct skin_out out;
+
+	skin_prepare(&out, fmt, dst);
+	/* with most of the mesh moving, marking costs more than it saves. on
+	 * zfat it still wins at 43% of the vertices and loses at 79%. */
+	for (j=0; dirty && j<mesh->deps.joints; j++)
+		if (dirty[j]) refs += mesh->deps.jstart[j+1] - mesh->deps.jstart[j];
+	if (!dirty || refs >= mesh->deps.jstart[mesh->deps.joints] / 8 * 5) {
+		skin_mesh(mesh, skel, &out);
+		return 0;
+	}
+
+	memset(mark, 0, mesh->num.verts);
+	for (j=0; j<mesh->deps.joints; j++) {
+		if (!dirty[j]) continue;
+		for (i=mesh->deps.jstart[j]; i<mesh->deps.jstart[j+1]; i++)
+			mark[mesh->deps.jverts[i]] = 1;
+	}
+
+	/* compact each bucket, the kernels still see uniform weight counts. */
+	for (b=0, n=0; b<MD5_SKIN_BUCKETS; b++) {
+		int from = n;
+		for (i=mesh->skin.start[b]; i<mesh->skin.start[b+1]; i++)
+			if (mark[mesh->skin.verts[i]])
+				list[n++] = mesh->skin.verts[i];
+		if (n > from) skin_kernels[b](mesh, skel, &list[from], n - from, &out);
+	}
+	for (i=mesh->skin.start[MD5_SKIN_BUCKETS]; i<mesh->num.verts; i++)
+		n += mark[mesh->skin.src[mesh->skin.verts[i]]];
+	skin_dups(mesh, mark, &out);
+	return mesh->num.verts - n;
+}
+
+size_t md5vfmt_size(const struct md5vfmt *fmt)
+{
+	size_t comp = fmt->type == MD5_VFMT_F32 ? sizeof(float) : sizeof(short);
+	return comp * (fmt->st ? 5 : 3);
+}
+
+/* reference skinner, one data-dependent inner loop for every vertex. */
+void md5model_mkmesh_generic(struct md5mesh *mesh, struct md5joint *skel)
 {
 	int j, k;
 
@@ -144,30 +398,611 @@ void md5model_mkmesh(struct md5mesh *mesh, struct md5joint *skel)
 	}
 }
 
+/* -------------------------------------------------------------------------- */
+/* skinning kernels, one per weight count. they accumulate in the same order  */
+/* as the generic loop so the results are bit identical.                      */
+/* -------------------------------------------------------------------------- */
+
+#define SKIN_TERM(_p, _w) { \
+	v3_t _wv; \
+	const struct md5joint *_joint = &skel[(_w)->joint]; \
+	quat_rotatep(&_wv, &_joint->ori, &(_w)->pos); \
+	(_p).x += (_joint->pos.x + _wv.x) * (_w)->bias; \
+	(_p).y += (_joint->pos.y + _wv.y) * (_w)->bias; \
+	(_p).z += (_joint->pos.z + _wv.z) * (_w)->bias; \
+}
+
+/* IEEE half, round to nearest, flushes denormals to zero. */
+static unsigned short skin_half(float f) {
+	unsigned int x, sign, mant;
+	int exp;
+
+	memcpy(&x, &f, sizeof(x));
+	sign = (x >> 16) & 0x8000;
+	exp = (int)((x >> 23) & 0xff) - 127 + 15;
+	mant = x & 0x7fffff;
+
+	if (exp <= 0) return sign;
+	if (exp >= 31) return sign | 0x7c00;
+	mant += 0x1000;
+	if (mant & 0x800000) {
+		mant = 0;
+		if (++exp >= 31) return sign | 0x7c00;
+	}
+	return sign | (exp << 10) | (mant >> 13);
+}
+
+static short skin_snorm(float f) {
+	if (f > 1) f = 1;
+	if (f < -1) f = -1;
+	return (short)(f * 32767.0f + (f < 0 ? -0.5f : 0.5f));
+}
+
+static void skin_store(const struct skin_out *out,
+		const struct md5mesh *mesh, int v, const v3_t *p) {
+	char *dst = out->dst + (size_t)v * out->stride;
+
+	switch (out->type) {
+	case MD5_VFMT_F32: {
+		float *f = (float *)dst;
+		f[0] = p->x; f[1] = p->y; f[2] = p->z;
+		break;
+	}
+	case MD5_VFMT_F16: {
+		unsigned short *h = (unsigned short *)dst;
+		h[0] = skin_half(p->x); h[1] = skin_half(p->y); h[2] = skin_half(p->z);
+		break;
+	}
+	case MD5_VFMT_SNORM16: {
+		short *q = (short *)dst;
+		q[0] = skin_snorm((p->x - out->center.x) * out->scale.x);
+		q[1] = skin_snorm((p->y - out->center.y) * out->scale.y);
+		q[2] = skin_snorm((p->z - out->center.z) * out->scale.z);
+		break;
+	}
+	}
+	if (out->st) skin_store_st(out, dst, &mesh->verts[v].st);
+}
+
+/* (s, t) right after the position. */
+static void skin_store_st(const struct skin_out *out, char *dst,
+		const v2_t *st) {
+	if (out->type == MD5_VFMT_F32) {
+		float *f = (float *)dst;
+		f[3] = st->x; f[4] = st->y;
+	} else {
+		unsigned short *h = (unsigned short *)dst + 3;
+		h[0] = skin_half(st->x); h[1] = skin_half(st->y);
+	}
+}
+
+/* v takes src's position, already written in whatever format, and keeps
+ * its own (s, t). */
+static void skin_copy(const struct skin_out *out,
+		const struct md5mesh *mesh, int v, int src) {
+	char *dst = out->dst + (size_t)v * out->stride;
+
+	memcpy(dst, out->dst + (size_t)src * out->stride,
+			out->type == MD5_VFMT_F32 ? 3 * sizeof(float) : 3 * sizeof(short));
+	if (out->st) skin_store_st(out, dst, &mesh->verts[v].st);
+}
+
+/* the vertices left out of the buckets, all of them or those whose source
+ * is marked. */
+static void skin_dups(const struct md5mesh *mesh, const unsigned char *mark,
+		const struct skin_out *out) {
+	int i;
+
+	for (i=mesh->skin.start[MD5_SKIN_BUCKETS]; i<mesh->num.verts; i++) {
+		int v = mesh->skin.verts[i], src = mesh->skin.src[v];
+		if (!mark || mark[src]) skin_copy(out, mesh, v, src);
+	}
+}
+
+static void skin_1(const struct md5mesh *mesh, const struct md5joint *skel,
+		const int *verts, int n, const struct skin_out *out) {
+	int i;
+
+	for (i=0; i<n; i++) {
+		const struct md5weight *w = &mesh->weights[mesh->verts[verts[i]].start];
+		v3_t p = {0, 0, 0};
+
+		SKIN_TERM(p, &w[0]);
+		skin_store(out, mesh, verts[i], &p);
+	}
+}
+
+static void skin_2(const struct md5mesh *mesh, const struct md5joint *skel,
+		const int *verts, int n, const struct skin_out *out) {
+	int i;
+
+	for (i=0; i<n; i++) {
+		const struct md5weight *w = &mesh->weights[mesh->verts[verts[i]].start];
+		v3_t p = {0, 0, 0};
+
+		SKIN_TERM(p, &w[0]);
+		SKIN_TERM(p, &w[1]);
+		skin_store(out, mesh, verts[i], &p);
+	}
+}
+
+static void skin_3(const struct md5mesh *mesh, const struct md5joint *skel,
+		const int *verts, int n, const struct skin_out *out) {
+	int i;
+
+	for (i=0; i<n; i++) {
+		const struct md5weight *w = &mesh->weights[mesh->verts[verts[i]].start];
+		v3_t p = {0, 0, 0};
+
+		SKIN_TERM(p, &w[0]);
+		SKIN_TERM(p, &w[1]);
+		SKIN_TERM(p, &w[2]);
+		skin_store(out, mesh, verts[i], &p);
+	}
+}
+
+static void skin_4(const struct md5mesh *mesh, const struct md5joint *skel,
+		const int *verts, int n, const struct skin_out *out) {
+	int i;
+
+	for (i=0; i<n; i++) {
+		const struct md5weight *w = &mesh->weights[mesh->verts[verts[i]].start];
+		v3_t p = {0, 0, 0};
+
+		SKIN_TERM(p, &w[0]);
+		SKIN_TERM(p, &w[1]);
+		SKIN_TERM(p, &w[2]);
+		SKIN_TERM(p, &w[3]);
+		skin_store(out, mesh, verts[i], &p);
+	}
+}
+
+static void skin_n(const struct md5mesh *mesh, const struct md5joint *skel,
+		const int *verts, int n, const struct skin_out *out) {
+	int i, k;
+
+	for (i=0; i<n; i++) {
+		const struct md5vertex *vertex = &mesh->verts[verts[i]];
+		const struct md5weight *w = &mesh->weights[vertex->start];
+		v3_t p = {0, 0, 0};
+
+		for (k=0; k<vertex->count; k++)
+			SKIN_TERM(p, &w[k]);
+		skin_store(out, mesh, verts[i], &p);
+	}
+}
+
+static void skin_prepare(struct skin_out *out,
+		const struct md5vfmt *fmt, void *dst) {
+	out->type = fmt->type;
+	out->st = fmt->st;
+	out->stride = fmt->stride ? fmt->stride : md5vfmt_size(fmt);
+	out->dst = dst;
+
+	if (fmt->type == MD5_VFMT_SNORM16) {
+		const struct md5bbox *box = &fmt->bounds;
+		v3_t ext;
+
+		v3_add(&out->center, &box->min, &box->max);
+		v3_sub(&ext, &box->max, &box->min);
+		out->center.x *= 0.5f; out->center.y *= 0.5f; out->center.z *= 0.5f;
+		out->scale.x = ext.x > 0 ? 2 / ext.x : 0;
+		out->scale.y = ext.y > 0 ? 2 / ext.y : 0;
+		out->scale.z = ext.z > 0 ? 2 / ext.z : 0;
+	}
+}
+
+static void skin_mesh(const struct md5mesh *mesh, const struct md5joint *skel,
+		const struct skin_out *out) {
+	int b;
+
+	for (b=0; b<MD5_SKIN_BUCKETS; b++) {
+		int from = mesh->skin.start[b];
+		skin_kernels[b](mesh, skel, &mesh->skin.verts[from],
+				mesh->skin.start[b+1] - from, out);
+	}
+	skin_dups(mesh, NULL, out);
+}
+
+/* src[v] is the first vertex with exactly the weights of v, found through
+ * a hash of their contents. */
+static void mesh_dedup(struct md5mesh *mesh) {
+	int i, k, size=1, *table;
+
+	mesh->skin.src = malloc(sizeof(int) * MD5MAX(mesh->num.verts, 1));
+	assert(mesh->skin.src);
+	while (size < 2 * mesh->num.verts) size <<= 1;
+	table = malloc(sizeof(int) * size);
+	assert(table);
+	for (i=0; i<size; i++) table[i] = -1;
+
+	for (i=0; i<mesh->num.verts; i++) {
+		const struct md5vertex *vertex = &mesh->verts[i];
+		const unsigned char *bytes;
+		unsigned long hash = 2166136261UL;
+		size_t len;
+
+		mesh->skin.src[i] = i;
+		if (vertex->count <= 0) continue;
+		bytes = (const unsigned char *)&mesh->weights[vertex->start];
+		len = sizeof(struct md5weight) * vertex->count;
+		for (k=0; k<(int)len; k++)
+			hash = ((hash ^ bytes[k]) * 16777619UL) & 0xffffffffUL;
+
+		for (k=hash & (size - 1); table[k] >= 0; k=(k + 1) & (size - 1)) {
+			const struct md5vertex *other = &mesh->verts[table[k]];
+			if (other->count == vertex->count && !memcmp(bytes,
+						&mesh->weights[other->start], len)) {
+				mesh->skin.src[i] = table[k];
+				break;
+			}
+		}
+		if (table[k] < 0) table[k] = i;
+	}
+	free(table);
+}
+
+/* counting sort of the vertices by weight count, once at load time. the
+ * ones skinned as copies go after the last bucket. */
+static void mesh_bucket(struct md5mesh *mesh) {
+	int i, b, dups, fill[MD5_SKIN_BUCKETS];
+
+	for (b=0; b<=MD5_SKIN_BUCKETS; b++)
+		mesh->skin.start[b] = 0;
+	for (i=0; i<mesh->num.verts; i++) {
+		if (mesh->skin.src[i] != i) continue;
+		b = mesh->verts[i].count - 1;
+		if (b < 0 || b >= MD5_SKIN_BUCKETS) b = MD5_SKIN_BUCKETS - 1;
+		mesh->skin.start[b+1]++;
+	}
+	for (b=0; b<MD5_SKIN_BUCKETS; b++) {
+		mesh->skin.start[b+1] += mesh->skin.start[b];
+		fill[b] = mesh->skin.start[b];
+	}
+
+	mesh->skin.verts = malloc(sizeof(int) * MD5MAX(mesh->num.verts, 1));
+	assert(mesh->skin.verts);
+	dups = mesh->skin.start[MD5_SKIN_BUCKETS];
+	for (i=0; i<mesh->num.verts; i++) {
+		if (mesh->skin.src[i] != i) {
+			mesh->skin.verts[dups++] = i;
+			continue;
+		}
+		b = mesh->verts[i].count - 1;
+		if (b < 0 || b >= MD5_SKIN_BUCKETS) b = MD5_SKIN_BUCKETS - 1;
+		mesh->skin.verts[fill[b]++] = i;
+	}
+}
+
+/* joint -> vertex map for incremental skinning, a vertex is listed once per
+ * joint no matter how many of its weights reference it. */
+static void mesh_deps(struct md5mesh *mesh) {
+	int i, k, joints=0, *fill;
+
+	for (i=0; i<mesh->num.weights; i++)
+		joints = MD5MAX(joints, mesh->weights[i].joint + 1);
+	mesh->deps.joints = joints;
+	mesh->deps.jstart = calloc(joints + 1, sizeof(int));
+	assert(mesh->deps.jstart);
+	fill = malloc(sizeof(int) * MD5MAX(joints, 1));
+	assert(fill);
+
+	for (i=0; i<joints; i++) fill[i] = -1;
+	for (i=0; i<mesh->num.verts; i++) {
+		const struct md5vertex *vertex = &mesh->verts[i];
+		for (k=vertex->start; k<vertex->start + vertex->count; k++) {
+			int j = mesh->weights[k].joint;
+			if (fill[j] == i) continue;
+			fill[j] = i;
+			mesh->deps.jstart[j+1]++;
+		}
+	}
+	for (i=0; i<joints; i++) {
+		mesh->deps.jstart[i+1] += mesh->deps.jstart[i];
+		fill[i] = -1;
+	}
+
+	mesh->deps.jverts
+		= malloc(sizeof(int) * MD5MAX(mesh->deps.jstart[joints], 1));
+	assert(mesh->deps.jverts);
+	for (i=0; i<mesh->num.verts; i++) {
+		const struct md5vertex *vertex = &mesh->verts[i];
+		for (k=vertex->start; k<vertex->start + vertex->count; k++) {
+			int j = mesh->weights[k].joint;
+			if (fill[j] == i) continue;
+			fill[j] = i;
+			mesh->deps.jverts[mesh->deps.jstart[j]++] = i;
+		}
+	}
+	/* the fill pass shifted every start by one slot. */
+	for (i=joints; i>0; i--)
+		mesh->deps.jstart[i] = mesh->deps.jstart[i-1];
+	mesh->deps.jstart[0] = 0;
+
+	free(fill);
+}
+
+/* a triangle edge by welded endpoints, only alive while mesh_edges sorts
+ * them. */
+struct mesh_half {
+	int lo, hi;     /* endpoints, lowest first. */
+	int a, b;       /* as the triangle winds them. */
+	int tri;
+};
+
+/* welds the vertices with exactly the same weights, which sit together in
+ * every pose and not only the bind one, then pairs every triangle edge with
+ * one running the other way over the same welded endpoints. */
+static void mesh_edges(struct md5mesh *mesh) {
+	int i, k, g, n, verts = mesh->num.verts, halves = 3 * mesh->num.tris;
+	struct mesh_half *half;
+	struct md5edge *edge;
+
+	/* skin.src is already the lowest index with the same weights. */
+	mesh->adj.weld = malloc(sizeof(int) * MD5MAX(verts, 1));
+	assert(mesh->adj.weld);
+	for (i=0; i<verts; i++)
+		mesh->adj.weld[i] = mesh->skin.src[i];
+
+	/* edges collapsed by the weld bound nothing, they are dropped. */
+	half = malloc(sizeof(struct mesh_half) * MD5MAX(halves, 1));
+	assert(half);
+	for (i=0, n=0; i<mesh->num.tris; i++) {
+		for (k=0; k<3; k++) {
+			struct mesh_half *h = &half[n];
+			h->a = mesh->adj.weld[mesh->tris[i].idx[k]];
+			h->b = mesh->adj.weld[mesh->tris[i].idx[(k + 1) % 3]];
+			h->lo = MD5MIN(h->a, h->b);
+			h->hi = MD5MAX(h->a, h->b);
+			h->tri = i;
+			n += h->a != h->b;
+		}
+	}
+	qsort(half, n, sizeof(struct mesh_half), mesh_half_cmp);
+
+	/* within a group of halves over the same endpoints, each takes the
+	 * first free one running the other way. what is left stays open. */
+	mesh->adj.edge = malloc(sizeof(struct md5edge) * MD5MAX(n, 1));
+	assert(mesh->adj.edge);
+	mesh->adj.edges = mesh->adj.open = 0;
+	for (g=0; g<n; g=i) {
+		for (i=g; i<n && half[i].lo == half[g].lo && half[i].hi == half[g].hi;)
+			i++;
+		for (k=g; k<i; k++) {
+			struct md5edge *e;
+			int m;
+
+			if (half[k].tri < 0) continue;
+			e = &mesh->adj.edge[mesh->adj.edges++];
+			e->v[0] = half[k].a;
+			e->v[1] = half[k].b;
+			e->tri[0] = half[k].tri;
+			e->tri[1] = -1;
+			for (m=k+1; m<i; m++) {
+				if (half[m].tri < 0 || half[m].a != half[k].b) continue;
+				e->tri[1] = half[m].tri;
+				half[m].tri = -1;
+				break;
+			}
+			mesh->adj.open += e->tri[1] < 0;
+		}
+	}
+	free(half);
+
+	/* open edges go last, walks over the closed ones then need no test. */
+	edge = malloc(sizeof(struct md5edge) * MD5MAX(mesh->adj.edges, 1));
+	assert(edge);
+	for (i=0, k=0, g=mesh->adj.edges - mesh->adj.open; i<mesh->adj.edges; i++)
+		edge[mesh->adj.edge[i].tri[1] < 0 ? g++ : k++] = mesh->adj.edge[i];
+	free(mesh->adj.edge);
+	mesh->adj.edge = edge;
+}
+
+static int mesh_half_cmp(const void *pa, const void *pb) {
+	const struct mesh_half *a = pa, *b = pb;
+
+	if (a->lo != b->lo) return a->lo - b->lo;
+	if (a->hi != b->hi) return a->hi - b->hi;
+	return a->tri - b->tri;
+}
+
+static void model_jbounds(struct md5model *model) {
+	int j, k, m;
+
+	model->jbounds
+		= malloc(sizeof(struct md5bbox) * MD5MAX(model->num.joints, 1));
+	assert(model->jbounds);
+	for (j=0; j<model->num.joints; j++) {
+		v3_make(&model->jbounds[j].min, 1, 1, 1);
+		v3_make(&model->jbounds[j].max, -1, -1, -1);
+	}
+	for (m=0; m<model->num.meshes; m++) {
+		const struct md5mesh *mesh = &model->meshes[m];
+
+		for (k=0; k<mesh->num.weights; k++) {
+			const struct md5weight *w = &mesh->weights[k];
+			struct md5bbox *box;
+
+			if (w->joint < 0 || w->joint >= model->num.joints) continue;
+			box = &model->jbounds[w->joint];
+			if (box->min.x > box->max.x) {
+				box->min = box->max = w->pos;
+				continue;
+			}
+			box->min.x = MD5MIN(box->min.x, w->pos.x);
+			box->min.y = MD5MIN(box->min.y, w->pos.y);
+			box->min.z = MD5MIN(box->min.z, w->pos.z);
+			box->max.x = MD5MAX(box->max.x, w->pos.x);
+			box->max.y = MD5MAX(box->max.y, w->pos.y);
+			box->max.z = MD5MAX(box->max.z, w->pos.z);
+		}
+	}
+}
+
+/* every vertex goes to the joint that weighs it the most, in that joint's
+ * bind space, and each joint's share gets a capsule. */
+static void model_capsules(struct md5model *model) {
+	int i, j, m, joints = model->num.joints, *start, *fill;
+	struct md5vfmt fmt;
+	v3_t *pts, *pos;
+
+	model->capsules = malloc(sizeof(struct md5capsule) * MD5MAX(joints, 1));
+	assert(model->capsules);
+	start = calloc(joints + 1, sizeof(int));
+	assert(start);
+	fill = malloc(sizeof(int) * MD5MAX(joints, 1));
+	assert(fill);
+	for (m=0; m<model->num.meshes; m++) {
+		const struct md5mesh *mesh = &model->meshes[m];
+		for (i=0; i<mesh->num.verts; i++)
+			if ((j = md5model_dominant(mesh, i)) >= 0 && j < joints)
+				start[j+1]++;
+	}
+	for (j=0; j<joints; j++) {
+		start[j+1] += start[j];
+		fill[j] = start[j];
+	}
+
+	fmt.type = MD5_VFMT_F32;
+	fmt.st = 0;
+	fmt.stride = 0;
+	pts = malloc(sizeof(v3_t) * MD5MAX(start[joints], 1));
+	assert(pts);
+	for (m=0; m<model->num.meshes; m++) {
+		const struct md5mesh *mesh = &model->meshes[m];
+
+		pos = malloc(sizeof(v3_t) * MD5MAX(mesh->num.verts, 1));
+		assert(pos);
+		md5model_skin(mesh, model->base, &fmt, pos);
+		for (i=0; i<mesh->num.verts; i++) {
+			const struct md5joint *bind;
+			quat_t inv;
+			v3_t d;
+
+			if ((j = md5model_dominant(mesh, i)) < 0 || j >= joints)
+				continue;
+			bind = &model->base[j];
+			quat_conjugate(&inv, &bind->ori);
+			v3_sub(&d, &pos[i], &bind->pos);
+			quat_rotatep(&pts[fill[j]++], &inv, &d);
+		}
+		free(pos);
+	}
+
+	for (j=0; j<joints; j++)
+		capsule_fit(&model->capsules[j], &pts[start[j]],
+				start[j+1] - start[j]);
+	free(pts);
+	free(start);
+	free(fill);
+}
+
+/* along the principal axis of the points, radius their farthest from it.
+ * the ends are then pulled in as far as every point stays covered, so the
+ * capsule is as short as that radius allows. */
+static void capsule_fit(struct md5capsule *cap, const v3_t *pts, int n) {
+	int i, k;
+	float cov[6]={0}, r2=0, lo=0, hi=0, ta, tb;
+	v3_t c, axis, d, col[3];
+
+	if (!n) {
+		v3_zero(&cap->a);
+		v3_zero(&cap->b);
+		cap->radius = -1;
+		return;
+	}
+
+	v3_zero(&c);
+	for (i=0; i<n; i++)
+		v3_add(&c, &c, &pts[i]);
+	v3_scale(&c, &c, n); /* divides. */
+	for (i=0; i<n; i++) {
+		v3_sub(&d, &pts[i], &c);
+		cov[0] += d.x*d.x; cov[1] += d.x*d.y; cov[2] += d.x*d.z;
+		cov[3] += d.y*d.y; cov[4] += d.y*d.z; cov[5] += d.z*d.z;
+	}
+
+	/* power iteration from the largest column of the covariance. */
+	v3_make(&col[0], cov[0], cov[1], cov[2]);
+	v3_make(&col[1], cov[1], cov[3], cov[4]);
+	v3_make(&col[2], cov[2], cov[4], cov[5]);
+	axis = col[0];
+	for (k=1; k<3; k++)
+		if (v3_dot(&col[k], &col[k]) > v3_dot(&axis, &axis))
+			axis = col[k];
+	if (v3_dot(&axis, &axis) < 1e-12f)
+		v3_make(&axis, 1, 0, 0);
+	for (k=0; k<16; k++) {
+		v3_normalize(&axis, &axis);
+		v3_make(&axis, v3_dot(&col[0], &axis), v3_dot(&col[1], &axis),
+				v3_dot(&col[2], &axis));
+		if (v3_dot(&axis, &axis) < 1e-12f) {
+			v3_make(&axis, 1, 0, 0);
+			break;
+		}
+	}
+	v3_normalize(&axis, &axis);
+
+	for (i=0; i<n; i++) {
+		float t;
+
+		v3_sub(&d, &pts[i], &c);
+		t = v3_dot(&d, &axis);
+		lo = i ? MD5MIN(lo, t) : t;
+		hi = i ? MD5MAX(hi, t) : t;
+		r2 = MD5MAX(r2, v3_dot(&d, &d) - t*t);
+	}
+	ta = lo + sqrt(r2);
+	tb = hi - sqrt(r2);
+	if (ta > tb) ta = tb = (lo + hi) * .5f;
+	for (i=0; i<n; i++) {
+		float t, reach;
+
+		v3_sub(&d, &pts[i], &c);
+		t = v3_dot(&d, &axis);
+		reach = sqrt(MD5MAX(r2 - (v3_dot(&d, &d) - t*t), 0));
+		ta = MD5MIN(ta, t + reach);
+		tb = MD5MAX(tb, t - reach);
+	}
+
+	v3_make(&cap->a, c.x + axis.x*ta, c.y + axis.y*ta, c.z + axis.z*ta);
+	v3_make(&cap->b, c.x + axis.x*tb, c.y + axis.y*tb, c.z + axis.z*tb);
+	cap->radius = sqrt(r2);
+}
+
+/* -------------------------------------------------------------------------- */
+
 static int parse_meshes(FILE *in, struct md5mesh *mesh) {
 
 	/* shader "<string>" */
 	if (!md5lex_checktk(in, "shader")) return 1;
+	mesh->shader = NULL;
 	if (!md5lex_readstring(in, &mesh->shader, NULL)) return 2;
 
 	/* numverts <int> */
 	if (!md5lex_checktk(in, "numverts")) return 3;
 	if (!md5lex_readint(in, &mesh->num.verts)) return 4;
-	assert(mesh->verts = malloc(sizeof (struct md5vertex)* mesh->num.verts));
+	mesh->verts = malloc(sizeof (struct md5vertex)* mesh->num.verts);
+	assert(mesh->verts);
 	if (parse_meshes_vertex(in, mesh->verts, mesh->num.verts)) return 5;
 
 	/* numtris <int> */
 	if (!md5lex_checktk(in, "numtris")) return 6;
 	if (!md5lex_readint(in, &mesh->num.tris)) return 7;
-	assert(mesh->tris = malloc(sizeof(struct md5tri)* mesh->num.tris));
+	mesh->tris = malloc(sizeof(struct md5tri)* mesh->num.tris);
+	assert(mesh->tris);
 	if (parse_meshes_tri(in, mesh->tris, mesh->num.tris)) return 8;
 
 	/* numweights <int> */
 	if (!md5lex_checktk(in, "numweights")) return 9;
 	if (!md5lex_readint(in, &mesh->num.weights)) return 10;
-	assert(mesh->weights = malloc(sizeof(struct md5weight)* mesh->num.weights));
+	mesh->weights = malloc(sizeof(struct md5weight)* mesh->num.weights);
+	assert(mesh->weights);
 	if (parse_meshes_weight(in, mesh->weights, mesh->num.weights)) return 11;
 
+	mesh_dedup(mesh);
+	mesh_bucket(mesh);
+	mesh_deps(mesh);
 	return 0;
 }
 
@@ -6,18 +6,32 @@
 #include "quat.h"
 #include "v3.h"
 #include "v2.h"
+#include "md5names.h"
 
 #define MD5_MAX_SHADER_SZ (256)
 #define MD5_MAX_NAME_SZ (64)
+#define MD5_SKIN_BUCKETS (5) /* 1, 2, 3, 4 weights and everything else. */
 
 struct md5joint {
 	v3_t pos;
 	quat_t ori;
 };
 
+struct md5bbox {
+	v3_t min, max;
+};
+
+/* a collision proxy, everything within radius of the segment a-b. */
+struct md5capsule {
+	v3_t a, b;
+	float radius;
+};
+
 struct md5jinfo {
-	char *name;
+	char *name;     /* owned by the names table. */
 	int parent;
+	int id;         /* interned name. */
+	int shared;     /* md5names_shared id of the name. */
 };
 
 struct md5vertex {
@@ -31,6 +45,13 @@ struct md5tri {
 	int idx[3];
 };
 
+/* a triangle edge between welded vertices, wound v[0] -> v[1] by tri[0]
+ * and the other way by tri[1], which is -1 when nothing shares the edge. */
+struct md5edge {
+	int v[2];
+	int tri[2];
+};
+
 struct md5weight {
 	v3_t pos;
 	int joint;
@@ -43,18 +64,83 @@ struct md5mesh {
 	struct md5tri *tris;
 	struct md5weight *weights;
 
+	/* vertices grouped by weight count, bucket b is verts[start[b]..start[b+1]).
+	 * vertices with the same weights as an earlier one (seam copies) are
+	 * left out of the buckets and follow them, they take the position of
+	 * src[v] once it is skinned. */
+	struct {
+		int *verts, *src;
+		int start[MD5_SKIN_BUCKETS + 1];
+	} skin;
+
+	/* vertices weighted by joint j are jverts[jstart[j]..jstart[j+1]). */
+	struct {
+		int joints;
+		int *jstart, *jverts;
+	} deps;
+
+	/* shared edges for shadow volumes. vertices duplicated along texture
+	 * seams are welded when their weights are the same, as skin.src does,
+	 * since only those stay together once animated. weld[v] is the lowest
+	 * such index and edges only ever use those. the open edges come last. */
+	struct {
+		int edges, open;
+		struct md5edge *edge;
+		int *weld;
+	} adj;
+
 	char *shader;
 };
 
+/* output layouts for md5model_skin, packed as position then (s, t).
+ * F32 writes floats, F16 IEEE halves, SNORM16 maps bounds to [-1, 1] per
+ * axis (pos = center + q/32767 * (max - min)/2) and writes s, t as halves. */
+enum md5vfmt_type {
+	MD5_VFMT_F32,
+	MD5_VFMT_F16,
+	MD5_VFMT_SNORM16
+};
+
+struct md5vfmt {
+	int type;
+	int st;               /* also write the texture coordinates. */
+	size_t stride;        /* 0 for tightly packed. */
+	struct md5bbox bounds;
+};
+
 struct md5model {
 	struct { int joints, meshes; } num;
 	struct md5joint *base;
 	struct md5jinfo *jinfo;
 	struct md5mesh *meshes;
+	struct md5names names;  /* joint names, valued by joint index. */
+
+	/* per joint, fitted around the bind pose of the vertices it weighs the
+	 * most and kept in that joint's bind space. radius is negative for
+	 * joints that dominate no vertex. */
+	struct md5capsule *capsules;
+
+	/* per joint, around the offsets of every weight on it, in its own
+	 * space. min > max for joints no weight uses. */
+	struct md5bbox *jbounds;
 };
 
 int md5model_load(const char *fname, struct md5model *md5);
 int md5model_read(FILE *in, struct md5model *md5);
+void md5model_end(struct md5model *md5);
+int md5model_joint(const struct md5model *md5, const char *name);
 void md5model_mkmesh(struct md5mesh *mesh, struct md5joint *skel);
+void md5model_mkmesh_generic(struct md5mesh *mesh, struct md5joint *skel);
+void md5model_skin(const struct md5mesh *mesh, const struct md5joint *skel,
+		const struct md5vfmt *fmt, void *dst);
+int md5model_skin_dirty(const struct md5mesh *mesh,
+		const struct md5joint *skel, const unsigned char *dirty,
+		unsigned char *mark, int *list, const struct md5vfmt *fmt, void *dst);
+size_t md5vfmt_size(const struct md5vfmt *fmt);
+int md5model_dominant(const struct md5mesh *mesh, int vert);
+void md5model_capsules(const struct md5model *md5, const struct md5joint *skel,
+		struct md5capsule *out);
+void md5model_bounds(const struct md5model *md5, const struct md5joint *skel,
+		struct md5bbox *out);
 
 #endif /* MD5MODEL_H */
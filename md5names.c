@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "md5names.h"
+
+static int md5names_slot(const struct md5names *, const char *, unsigned);
+static void md5names_grow(struct md5names *);
+
+/* one table for every model and clip, never shrinks. */
+static struct md5names shared = { 0, 0, -1, NULL, NULL, NULL, NULL };
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* -------------------------------------------------------------------------- */
+
+void md5names_init(struct md5names *names) {
+	names->count = names->cap = 0;
+	names->mask = -1;
+	names->str = NULL;
+	names->hash = NULL;
+	names->value = NULL;
+	names->index = NULL;
+}
+
+void md5names_end(struct md5names *names) {
+	int i;
+
+	for (i=0; i<names->count; i++)
+		free(names->str[i]);
+	free(names->str);
+	free(names->hash);
+	free(names->value);
+	free(names->index);
+	md5names_init(names);
+}
+
+/* id of s, adding it (with value) the first time it is seen. */
+int md5names_intern(struct md5names *names, const char *s, int value) {
+	unsigned h = md5names_hash(s);
+	int slot, id;
+
+	if (names->count >= (names->mask + 1) / 2) md5names_grow(names);
+	slot = md5names_slot(names, s, h);
+	if (names->index[slot] >= 0) return names->index[slot];
+
+	if (names->count == names->cap) {
+		names->cap = names->cap ? names->cap * 2 : 16;
+		names->str = realloc(names->str, sizeof(char *) * names->cap);
+		assert(names->str);
+		names->hash = realloc(names->hash, sizeof(unsigned) * names->cap);
+		assert(names->hash);
+		names->value = realloc(names->value, sizeof(int) * names->cap);
+		assert(names->value);
+	}
+	id = names->count++;
+	names->str[id] = malloc(strlen(s) + 1);
+	assert(names->str[id]);
+	strcpy(names->str[id], s);
+	names->hash[id] = h;
+	names->value[id] = value;
+	names->index[slot] = id;
+	return id;
+}
+
+/* -1 when s was never interned. */
+int md5names_id(const struct md5names *names, const char *s) {
+	if (!names->count) return -1;
+	return names->index[md5names_slot(names, s, md5names_hash(s))];
+}
+
+/* id of s in the process wide table, equal ids are equal strings whichever
+ * model or clip they came from. locks, loads run on the pool's threads. */
+int md5names_shared(const char *s) {
+	int id;
+
+	pthread_mutex_lock(&shared_lock);
+	id = md5names_intern(&shared, s, 0);
+	pthread_mutex_unlock(&shared_lock);
+	return id;
+}
+
+/* fnv-1a. */
+unsigned md5names_hash(const char *s) {
+	unsigned h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* slot holding s, or the empty one it would go in. */
+static int md5names_slot(const struct md5names *names, const char *s,
+		unsigned h) {
+	int slot = h & names->mask, id;
+
+	while ((id = names->index[slot]) >= 0) {
+		if (names->hash[id] == h && !strcmp(names->str[id], s))
+			break;
+		slot = (slot + 1) & names->mask;
+	}
+	return slot;
+}
+
+static void md5names_grow(struct md5names *names) {
+	int i, size = names->mask < 0 ? 32 : (names->mask + 1) * 2;
+
+	free(names->index);
+	names->index = malloc(sizeof(int) * size);
+	assert(names->index);
+	names->mask = size - 1;
+	for (i=0; i<size; i++)
+		names->index[i] = -1;
+	for (i=0; i<names->count; i++) {
+		int slot = names->hash[i] & names->mask;
+		while (names->index[slot] >= 0)
+			slot = (slot + 1) & names->mask;
+		names->index[slot] = i;
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef MD5NAMES_H
+#define MD5NAMES_H
+
+/* interned strings with a hash index. ids are dense, in insertion order,
+ * and every id carries an int value (joint tables store the joint index). */
+struct md5names {
+	int count, cap, mask;
+	char **str;
+	unsigned *hash;
+	int *value;
+	int *index;    /* open addressing over ids, -1 when empty. */
+};
+
+#define md5names_str(_n, _id)   ((_n)->str[_id])
+#define md5names_value(_n, _id) ((_n)->value[_id])
+
+void     md5names_init(struct md5names *);
+void     md5names_end(struct md5names *);
+int      md5names_intern(struct md5names *, const char *, int value);
+int      md5names_id(const struct md5names *, const char *);
+int      md5names_shared(const char *);
+unsigned md5names_hash(const char *);
+
+#endif /* MD5NAMES_H */
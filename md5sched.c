@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "md5sched.h"
+
+static int
+md5sched_interval(const struct md5sched *, const struct md5inst *);
+static int
+md5sched_due_cmp(const void *, const void *);
+
+/* -------------------------------------------------------------------------- */
+
+void md5inst_init(struct md5inst *inst, int joints) {
+	inst->distance = 0;
+	inst->importance = 1;
+	inst->interval = 1;
+	inst->next = -1;
+	inst->at = 0;
+	inst->t0 = 0;
+	inst->t1 = -1;
+	inst->joints = joints;
+	inst->prev = malloc(sizeof(struct md5joint) * MD5_MAX(joints, 1));
+	assert(inst->prev);
+	inst->cur = malloc(sizeof(struct md5joint) * MD5_MAX(joints, 1));
+	assert(inst->cur);
+}
+
+void md5inst_end(struct md5inst *inst) {
+	free(inst->prev);
+	free(inst->cur);
+}
+
+/* takes skel, posed for inst->at, in an update handed out at tick. blending
+ * starts from what was drawn at tick so late updates do not pop. */
+void md5inst_set(struct md5inst *inst, const struct md5joint *skel,
+		int tick) {
+	if (inst->t1 < 0) /* the first update has nothing to blend from. */
+		memcpy(inst->prev, skel, sizeof(struct md5joint) * inst->joints);
+	else
+		md5inst_pose(inst, tick, inst->prev);
+	memcpy(inst->cur, skel, sizeof(struct md5joint) * inst->joints);
+	inst->t0 = tick;
+	inst->t1 = inst->at;
+}
+
+/* the pose to draw at tick, out may be inst->prev. */
+void md5inst_pose(const struct md5inst *inst, int tick,
+		struct md5joint *out) {
+	int i;
+	float t, s;
+
+	if (tick >= inst->t1 || inst->t1 <= inst->t0) {
+		memcpy(out, inst->cur, sizeof(struct md5joint) * inst->joints);
+		return;
+	}
+	if (tick <= inst->t0) {
+		if (out != inst->prev)
+			memcpy(out, inst->prev, sizeof(struct md5joint) * inst->joints);
+		return;
+	}
+	/* every component only reads its own, out may alias prev. */
+	t = (float)(tick - inst->t0) / (inst->t1 - inst->t0);
+	for (i=0; i<inst->joints; i++) {
+		const struct md5joint *a = &inst->prev[i], *b = &inst->cur[i];
+		struct md5joint *o = &out[i];
+
+		/* shortest way round. */
+		s = a->ori.w*b->ori.w + a->ori.x*b->ori.x + a->ori.y*b->ori.y
+			+ a->ori.z*b->ori.z < 0 ? -t : t;
+		o->pos.x = a->pos.x + (b->pos.x - a->pos.x) * t;
+		o->pos.y = a->pos.y + (b->pos.y - a->pos.y) * t;
+		o->pos.z = a->pos.z + (b->pos.z - a->pos.z) * t;
+		o->ori.w = a->ori.w * (1 - t) + b->ori.w * s;
+		o->ori.x = a->ori.x * (1 - t) + b->ori.x * s;
+		o->ori.y = a->ori.y * (1 - t) + b->ori.y * s;
+		o->ori.z = a->ori.z * (1 - t) + b->ori.z * s;
+		quat_normalize(&o->ori, &o->ori);
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+
+void md5sched_init(struct md5sched *sched, float near, float far,
+		int max_interval, int budget, int mode) {
+	sched->near = near;
+	sched->far = far;
+	sched->max_interval = MD5_MAX(max_interval, 1);
+	sched->budget = budget;
+	sched->mode = mode;
+	sched->tick = -1;
+	sched->spread = 0;
+	sched->due = NULL;
+	sched->cap = 0;
+	sched->stats.ticks = sched->stats.updates = 0;
+	sched->stats.deferred = sched->stats.held = 0;
+}
+
+void md5sched_end(struct md5sched *sched) {
+	free(sched->due);
+	sched->due = NULL;
+	sched->cap = 0;
+}
+
+/* starts the next tick, sched->tick, and fills update with the instances
+ * to pose and skin in it, returning how many. pose each at its inst->at and
+ * md5inst_set it with this tick. budget <= 0 means no limit. */
+int md5sched_tick(struct md5sched *sched, struct md5inst *insts, int n,
+		int *update) {
+	int i, due=0, count, tick = ++sched->tick;
+
+	if (n > sched->cap) {
+		sched->cap = n;
+		sched->due = realloc(sched->due, sizeof(struct md5sched_due) * n);
+		assert(sched->due);
+	}
+
+	for (i=0; i<n; i++) {
+		struct md5inst *inst = &insts[i];
+
+		inst->interval = md5sched_interval(sched, inst);
+		if (inst->next < 0) {
+			/* new ones start staggered across their interval. */
+			inst->next = tick + sched->spread++ % inst->interval;
+		} else if (inst->next > inst->t0 + inst->interval) {
+			/* came closer, do not wait out the old interval. */
+			inst->next = MD5_MAX(inst->t0 + inst->interval, tick);
+		}
+		if (inst->next > tick) {
+			sched->stats.held++;
+			continue;
+		}
+		sched->due[due].key = (1 + tick - inst->next) * inst->importance
+			/ inst->interval;
+		sched->due[due].inst = i;
+		due++;
+	}
+
+	count = due;
+	if (sched->budget > 0 && due > sched->budget) {
+		qsort(sched->due, due, sizeof(struct md5sched_due),
+				md5sched_due_cmp);
+		count = sched->budget;
+		sched->stats.deferred += due - count;
+	}
+	for (i=0; i<count; i++) {
+		struct md5inst *inst = &insts[sched->due[i].inst];
+		inst->next = tick + inst->interval;
+		inst->at = sched->mode == MD5_SCHED_HOLD ? tick : inst->next;
+		update[i] = sched->due[i].inst;
+	}
+
+	sched->stats.updates += count;
+	sched->stats.ticks++;
+	return count;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int md5sched_interval(const struct md5sched *sched,
+		const struct md5inst *inst) {
+	float d = inst->distance / MD5_MAX(inst->importance, 1e-3f);
+
+	if (d <= sched->near || sched->far <= sched->near) return 1;
+	if (d >= sched->far) return sched->max_interval;
+	return 1 + (int)((d - sched->near) / (sched->far - sched->near)
+			* (sched->max_interval - 1) + .5f);
+}
+
+/* highest key first, instance order breaks ties. */
+static int md5sched_due_cmp(const void *pa, const void *pb) {
+	const struct md5sched_due *a = pa, *b = pb;
+
+	if (a->key != b->key) return a->key < b->key ? 1 : -1;
+	return a->inst - b->inst;
+}
@@ -0,0 +1,51 @@
+#ifndef MD5SCHED_H
+#define MD5SCHED_H
+
+#include "md5anim.h"
+
+/* what an instance shows between its updates. vertices are only skinned on
+ * updates, an interpolated pose is for joints, attachments and gpu skinning. */
+enum md5lerp {
+	MD5_SCHED_HOLD,          /* the pose of its last update. */
+	MD5_SCHED_INTERPOLATE    /* updates pose ahead, at the tick the next one
+	                          * is due, and the drawn pose blends toward it. */
+};
+
+/* one animated entity, owned by the caller. distance and importance are the
+ * caller's to change between ticks, everything else is the scheduler's. */
+struct md5inst {
+	float distance, importance;
+
+	int interval;            /* ticks between updates. */
+	int next;                /* tick the next update is due, -1 when new. */
+	int at;                  /* tick an update hands out should pose for. */
+	int t0, t1;              /* prev is drawn at t0, cur from t1 on. */
+	int joints;
+	struct md5joint *prev, *cur;
+};
+
+/* interval grows linearly from 1 at near to max_interval at far, distance
+ * taken over importance. at most budget updates are handed out per tick,
+ * the rest wait, most overdue and important first. */
+struct md5sched {
+	float near, far;
+	int max_interval, budget, mode;
+	int tick, spread;
+
+	struct md5sched_due { float key; int inst; } *due;
+	int cap;
+
+	struct { long ticks, updates, deferred, held; } stats;
+};
+
+void md5inst_init(struct md5inst *, int joints);
+void md5inst_end(struct md5inst *);
+void md5inst_set(struct md5inst *, const struct md5joint *skel, int tick);
+void md5inst_pose(const struct md5inst *, int tick, struct md5joint *out);
+
+void md5sched_init(struct md5sched *, float near, float far,
+		int max_interval, int budget, int mode);
+void md5sched_end(struct md5sched *);
+int  md5sched_tick(struct md5sched *, struct md5inst *, int n, int *update);
+
+#endif /* MD5SCHED_H */
@@ -0,0 +1,100 @@
+#include "md5shadow.h"
+#include "md5lex.h"
+
+#define SHADOW_BLOCK (64)
+
+#define SHADOW_POS(_pos, _stride, _v) \
+	((const float *)((const char *)(_pos) + (size_t)(_v) * (_stride)))
+
+/* -------------------------------------------------------------------------- */
+
+/* room md5shadow_volume needs in out, caps or not. */
+int md5shadow_max(const struct md5mesh *mesh, int caps) {
+	return 6 * mesh->adj.edges + (caps ? 6 * mesh->num.tris : 0);
+}
+
+/* facing[t] is 1 when triangle t faces light, else 0. */
+void md5shadow_facing(const struct md5mesh *mesh, const float *pos,
+		size_t stride, const v3_t *light, unsigned char *facing) {
+	/* copied out, stores through facing may alias anything. */
+	const struct md5tri *tris = mesh->tris;
+	float lx = light->x, ly = light->y, lz = light->z;
+	int t, count = mesh->num.tris;
+
+	for (t=0; t<count; t++) {
+		const int *idx = tris[t].idx;
+		const float *a = SHADOW_POS(pos, stride, idx[0]);
+		const float *b = SHADOW_POS(pos, stride, idx[1]);
+		const float *c = SHADOW_POS(pos, stride, idx[2]);
+		float ux = b[0] - a[0], uy = b[1] - a[1], uz = b[2] - a[2];
+		float vx = c[0] - a[0], vy = c[1] - a[1], vz = c[2] - a[2];
+
+		facing[t] = (uy*vz - uz*vy) * (lx - a[0])
+			+ (uz*vx - ux*vz) * (ly - a[1])
+			+ (ux*vy - uy*vx) * (lz - a[2]) > 0;
+	}
+}
+
+/* writes the volume's triangles to out, md5shadow_max ints at most, and
+ * returns how many indices that is. caps are only needed when the eye may
+ * be inside the volume (z-fail). edges and triangles are taken a block at
+ * a time: the ones that count are picked out without branching, writing
+ * every candidate's number and only moving past those that count, then
+ * only those get emitted. caps use the welded vertices too, so they meet
+ * the sides on the same indices. */
+int md5shadow_volume(const struct md5mesh *mesh, const unsigned char *facing,
+		int caps, int *out) {
+	const struct md5edge *edge = mesh->adj.edge;
+	const struct md5tri *tris = mesh->tris;
+	const int *weld = mesh->adj.weld;
+	int i, k, m, end, n=0, far = mesh->num.verts;
+	int edges = mesh->adj.edges, closed = edges - mesh->adj.open;
+	int pick[SHADOW_BLOCK];
+
+	/* an open edge counts as bordering a triangle facing away. */
+	for (i=0; i<edges; i=end) {
+		end = MD5_MIN(i + SHADOW_BLOCK, edges);
+		for (k=i, m=0; k<MD5_MIN(end, closed); k++) {
+			const struct md5edge *e = &edge[k];
+			pick[m] = k;
+			m += facing[e->tri[0]] ^ facing[e->tri[1]];
+		}
+		for (; k<end; k++) {
+			pick[m] = k;
+			m += facing[edge[k].tri[0]];
+		}
+		for (k=0; k<m; k++, n+=6) {
+			const struct md5edge *e = &edge[pick[k]];
+			/* a -> b as the triangle facing the light winds it. */
+			int f1 = pick[k] < closed ? facing[e->tri[1]] : 0;
+			int a = e->v[f1], b = e->v[f1 ^ 1];
+
+			out[n] = b;
+			out[n+1] = a;
+			out[n+2] = a + far;
+			out[n+3] = b;
+			out[n+4] = a + far;
+			out[n+5] = b + far;
+		}
+	}
+
+	for (i=0; caps && i<mesh->num.tris; i=end) {
+		end = MD5_MIN(i + SHADOW_BLOCK, mesh->num.tris);
+		for (k=i, m=0; k<end; k++) {
+			pick[m] = k;
+			m += facing[k];
+		}
+		for (k=0; k<m; k++, n+=6) {
+			const int *idx = tris[pick[k]].idx;
+			int a = weld[idx[0]], b = weld[idx[1]], c = weld[idx[2]];
+
+			out[n] = a;
+			out[n+1] = b;
+			out[n+2] = c;
+			out[n+3] = c + far;
+			out[n+4] = b + far;
+			out[n+5] = a + far;
+		}
+	}
+	return n;
+}
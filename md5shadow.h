@@ -0,0 +1,22 @@
+#ifndef MD5SHADOW_H
+#define MD5SHADOW_H
+
+#include "md5model.h"
+
+/* stencil shadow volumes from a mesh's shared edges, see md5mesh.adj.
+ * indices below num.verts are the skinned vertices, vertex v pushed away
+ * from the light to infinity is v + num.verts: draw the positions twice,
+ * with w = 1 and then w = 0. positions are float x, y, z every stride bytes
+ * as md5model_skin writes them with MD5_VFMT_F32.
+ *
+ * triangles facing the light (normal (p1-p0) x (p2-p0) toward it) close
+ * the volume at the front, the same ones at infinity close it at the back.
+ * sides are wound to face out with them. */
+
+int  md5shadow_max(const struct md5mesh *, int caps);
+void md5shadow_facing(const struct md5mesh *, const float *pos, size_t stride,
+		const v3_t *light, unsigned char *facing);
+int  md5shadow_volume(const struct md5mesh *, const unsigned char *facing,
+		int caps, int *out);
+
+#endif /* MD5SHADOW_H */
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "md5snap.h"
+#include "md5lex.h"
+
+/* keeps quantized values and their deltas inside 32 bits. */
+#define MD5_SNAP_RANGE (1L << 29)
+
+/* per joint: pos x, y, z, the three smaller of the orientation's components
+ * and which one was left out. */
+#define MD5_SNAP_COMPS (7)
+
+static void
+quantize(const struct md5snap *, const struct md5joint *, long *);
+static long
+quantize_round(float, float);
+static size_t
+varint_put(unsigned char *, long);
+static long
+varint_get(const unsigned char *, const unsigned char *, long *);
+
+/* -------------------------------------------------------------------------- */
+
+/* ref NULL starts from the identity. */
+void md5snap_init(struct md5snap *snap, int joints, int mode, float pos_step,
+		float ori_step, const struct md5joint *ref) {
+	snap->joints = joints;
+	snap->mode = mode;
+	snap->pos_step = pos_step;
+	snap->ori_step = ori_step;
+	snap->ref = malloc(sizeof(long) * MD5_SNAP_COMPS * MD5_MAX(joints, 1));
+	assert(snap->ref);
+	snap->cur = malloc(sizeof(long) * MD5_SNAP_COMPS * MD5_MAX(joints, 1));
+	assert(snap->cur);
+	md5snap_reset(snap, ref);
+}
+
+void md5snap_end(struct md5snap *snap) {
+	free(snap->ref);
+	free(snap->cur);
+}
+
+/* both ends must reset together, to the same pose. */
+void md5snap_reset(struct md5snap *snap, const struct md5joint *ref) {
+	int j;
+
+	if (ref) {
+		quantize(snap, ref, snap->ref);
+		return;
+	}
+	/* the identity: no offset, w the dropped component and x, y, z 0. */
+	memset(snap->ref, 0, sizeof(long) * MD5_SNAP_COMPS * snap->joints);
+	for (j=0; j<snap->joints; j++)
+		snap->ref[MD5_SNAP_COMPS * j + 6] = 3;
+}
+
+/* room a snapshot may take: the mask, then a flag byte and seven varints
+ * of at most five bytes for every joint. */
+size_t md5snap_max(const struct md5snap *snap) {
+	return (snap->joints + 7) / 8
+		+ (size_t)snap->joints * (1 + MD5_SNAP_COMPS * 5);
+}
+
+/* writes local, the pose relative to each joint's parent, to out and
+ * returns how many bytes that took. */
+size_t md5snap_encode(struct md5snap *snap, const struct md5joint *local,
+		unsigned char *out) {
+	int j, c, mask = (snap->joints + 7) / 8;
+	unsigned char *at = out + mask;
+	long *tmp;
+
+	quantize(snap, local, snap->cur);
+	memset(out, 0, mask);
+	for (j=0; j<snap->joints; j++) {
+		const long *cur = &snap->cur[MD5_SNAP_COMPS * j];
+		const long *ref = &snap->ref[MD5_SNAP_COMPS * j];
+		unsigned char *flags = at, f=0;
+
+		for (c=0; c<MD5_SNAP_COMPS; c++)
+			f |= (cur[c] != ref[c]) << c;
+		if (!f) continue;
+
+		out[j >> 3] |= 1 << (j & 7);
+		*flags = f;
+		at++;
+		for (c=0; c<MD5_SNAP_COMPS; c++)
+			if (f >> c & 1) at += varint_put(at, cur[c] - ref[c]);
+	}
+
+	if (snap->mode == MD5_SNAP_PREVIOUS) {
+		tmp = snap->ref;
+		snap->ref = snap->cur;
+		snap->cur = tmp;
+	}
+	return at - out;
+}
+
+/* reads a snapshot from the len bytes at in into local and returns how many
+ * of them it took, -1 when they end early. a snapshot that fails leaves
+ * snap as it was. */
+long md5snap_decode(struct md5snap *snap, const unsigned char *in,
+		size_t len, struct md5joint *local) {
+	const unsigned char *at, *end = in + len;
+	int j, c, mask = (snap->joints + 7) / 8;
+	long *tmp, d, n;
+
+	if (len < (size_t)mask) return -1;
+	memcpy(snap->cur, snap->ref, sizeof(long) * MD5_SNAP_COMPS * snap->joints);
+	for (j=0, at = in + mask; j<snap->joints; j++) {
+		long *cur = &snap->cur[MD5_SNAP_COMPS * j];
+		int f;
+
+		if (!(in[j >> 3] >> (j & 7) & 1)) continue;
+		if (at >= end) return -1;
+		f = *at++;
+		for (c=0; c<MD5_SNAP_COMPS; c++) {
+			if (!(f >> c & 1)) continue;
+			if (!(n = varint_get(at, end, &d))) return -1;
+			at += n;
+			/* only a corrupt stream goes past the range, keep it there
+			 * rather than overflow. */
+			d = MD5_MAX(MD5_MIN(d, 2 * MD5_SNAP_RANGE), -2 * MD5_SNAP_RANGE);
+			cur[c] = MD5_MAX(MD5_MIN(cur[c] + d, MD5_SNAP_RANGE),
+					-MD5_SNAP_RANGE);
+		}
+		if ((unsigned long)cur[6] > 3) return -1;
+	}
+
+	for (j=0; j<snap->joints; j++) {
+		const long *cur = &snap->cur[MD5_SNAP_COMPS * j];
+		struct md5joint *l = &local[j];
+		float *q = &l->ori.x, t=1;
+		int i, big = (int)cur[6];
+
+		v3_make(&l->pos, cur[0] * snap->pos_step, cur[1] * snap->pos_step,
+				cur[2] * snap->pos_step);
+		for (i=0, c=3; i<4; i++) {
+			if (i == big) continue;
+			q[i] = cur[c++] * snap->ori_step;
+			t -= q[i] * q[i];
+		}
+		q[big] = t > 0 ? sqrt(t) : 0;
+		/* back to w <= 0, as the loader has them. */
+		if (l->ori.w > 0)
+			for (i=0; i<4; i++)
+				q[i] = -q[i];
+	}
+
+	if (snap->mode == MD5_SNAP_PREVIOUS) {
+		tmp = snap->ref;
+		snap->ref = snap->cur;
+		snap->cur = tmp;
+	}
+	return at - in;
+}
+
+/* -------------------------------------------------------------------------- */
+
+/* the largest orientation component is left out and rebuilt, flipped to be
+ * positive. rebuilding w from x, y, z as the loader does loses most where w
+ * is small, the largest never is. */
+static void quantize(const struct md5snap *snap,
+		const struct md5joint *local, long *out) {
+	int i, j, c, big;
+
+	for (j=0; j<snap->joints; j++, out += MD5_SNAP_COMPS) {
+		const struct md5joint *l = &local[j];
+		const float *q = &l->ori.x;
+		float s;
+
+		out[0] = quantize_round(l->pos.x, snap->pos_step);
+		out[1] = quantize_round(l->pos.y, snap->pos_step);
+		out[2] = quantize_round(l->pos.z, snap->pos_step);
+		for (i=1, big=0; i<4; i++)
+			if (fabs(q[i]) > fabs(q[big])) big = i;
+		s = q[big] < 0 ? -1 : 1;
+		for (i=0, c=3; i<4; i++)
+			if (i != big) out[c++] = quantize_round(s * q[i], snap->ori_step);
+		out[6] = big;
+	}
+}
+
+static long quantize_round(float v, float step) {
+	double q = floor(v / step + .5);
+
+	if (q > MD5_SNAP_RANGE) return MD5_SNAP_RANGE;
+	if (q < -MD5_SNAP_RANGE) return -MD5_SNAP_RANGE;
+	return (long)q;
+}
+
+/* zigzag, so small deltas either way take a byte, seven bits a byte. */
+static size_t varint_put(unsigned char *out, long v) {
+	unsigned long z = v < 0 ? ((unsigned long)-(v + 1) << 1) | 1
+		: (unsigned long)v << 1;
+	size_t n=0;
+
+	while (z >= 0x80) {
+		out[n++] = (unsigned char)(z | 0x80);
+		z >>= 7;
+	}
+	out[n++] = (unsigned char)z;
+	return n;
+}
+
+/* bytes read, 0 when the varint runs past end or is too long. */
+static long varint_get(const unsigned char *in, const unsigned char *end,
+		long *v) {
+	unsigned long z=0;
+	long n=0;
+
+	do {
+		if (n >= end - in || n == 5) return 0;
+		z |= (unsigned long)(in[n] & 0x7f) << (7 * n);
+	} while (in[n++] & 0x80);
+	*v = z & 1 ? -(long)(z >> 1) - 1 : (long)(z >> 1);
+	return n;
+}
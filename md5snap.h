@@ -0,0 +1,39 @@
+#ifndef MD5SNAP_H
+#define MD5SNAP_H
+
+#include <stddef.h>
+#include "md5model.h"
+
+/* what a snapshot is taken against. */
+enum md5snap_mode {
+	MD5_SNAP_REFERENCE,    /* always the pose given to md5snap_reset, any
+	                        * snapshot decodes on its own. */
+	MD5_SNAP_PREVIOUS      /* the last snapshot, smaller but every one of
+	                        * them must be decoded, in order. */
+};
+
+/* compact local poses for replication and recording. positions are
+ * quantized to pos_step, orientations to ori_step in their three smaller
+ * components, the largest rebuilt from them. a snapshot is a bit per joint
+ * that changed against the reference, then for each of those a byte
+ * flagging its changed components and their zigzag varint deltas.
+ *
+ * the encoder and decoder each keep one, made alike and reset to the same
+ * pose. both only hold quantized values, they never drift apart. */
+struct md5snap {
+	int joints, mode;
+	float pos_step, ori_step;
+	long *ref, *cur;       /* quantized, 7 per joint. */
+};
+
+void   md5snap_init(struct md5snap *, int joints, int mode, float pos_step,
+		float ori_step, const struct md5joint *ref);
+void   md5snap_end(struct md5snap *);
+void   md5snap_reset(struct md5snap *, const struct md5joint *ref);
+size_t md5snap_max(const struct md5snap *);
+size_t md5snap_encode(struct md5snap *, const struct md5joint *local,
+		unsigned char *out);
+long   md5snap_decode(struct md5snap *, const unsigned char *in, size_t len,
+		struct md5joint *local);
+
+#endif /* MD5SNAP_H */
@@ -0,0 +1,280 @@
+#define _XOPEN_SOURCE 500
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "md5watch.h"
+
+#define MD5_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+static int
+md5watch_add(struct md5watch *, struct md5watched *, const char *);
+static void
+md5watch_events(struct md5watch *);
+static void
+md5watch_submit(struct md5watch *, struct md5watched *);
+static void
+md5watch_collect(struct md5watch *, struct md5watched *);
+static void
+md5watch_swap_model(struct md5watch *, struct md5watched *);
+static void
+md5watch_swap_anim(struct md5watch *, struct md5watched *);
+static void
+md5watch_done(struct md5watched *, int);
+static void
+md5watched_drop(struct md5watch *, struct md5watched *);
+static void
+md5watched_discard(struct md5watched *);
+
+/* -------------------------------------------------------------------------- */
+
+int md5watch_init(struct md5watch *watch, struct md5async *pool) {
+	if ((watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) return 1;
+	watch->pool = pool;
+	watch->cache = NULL;
+	watch->files = NULL;
+	watch->stats.events = watch->stats.reloads = 0;
+	watch->stats.swaps = watch->stats.rejected = 0;
+	return 0;
+}
+
+/* reloads still in flight are cancelled and whatever they loaded dropped,
+ * the live models and clips stay as they are. clips go first, a model
+ * reload is not dropped while clips still load against it. */
+void md5watch_end(struct md5watch *watch) {
+	struct md5watched *w;
+
+	for (w = watch->files; w; w = w->next)
+		if (w->type == MD5_JOB_ANIM) md5watched_drop(watch, w);
+	for (w = watch->files; w; w = w->next)
+		if (w->type == MD5_JOB_MODEL) md5watched_drop(watch, w);
+	close(watch->fd);
+	watch->files = NULL;
+}
+
+/* model, already loaded from fname, gets reloaded whenever fname changes. */
+int md5watch_model(struct md5watch *watch, struct md5watched *w,
+		const char *fname, struct md5model *model) {
+	w->type = MD5_JOB_MODEL;
+	w->model = model;
+	w->anim = NULL;
+	w->parent = NULL;
+	return md5watch_add(watch, w, fname);
+}
+
+/* as md5watch_model for a clip. a reload must match model, or parent's
+ * model when parent is given, and a model reload must match the clip. a
+ * clip and its model written together are swapped in together. */
+int md5watch_anim(struct md5watch *watch, struct md5watched *w,
+		const char *fname, struct md5anim *anim, struct md5model *model,
+		struct md5watched *parent) {
+	w->type = MD5_JOB_ANIM;
+	w->model = parent ? parent->model : model;
+	w->anim = anim;
+	w->parent = parent;
+	return md5watch_add(watch, w, fname);
+}
+
+/* call between frames, on the thread that draws: everything swapped
+ * happens in here. picks up changed files, starts their reloads on the
+ * pool and swaps in the ones that are done and still fit. never blocks on
+ * a reload, returns how many were swapped in. */
+int md5watch_poll(struct md5watch *watch) {
+	long swaps = watch->stats.swaps;
+	struct md5watched *w;
+
+	md5watch_events(watch);
+	for (w = watch->files; w; w = w->next)
+		md5watch_collect(watch, w);
+
+	/* models first, their clips are checked against what they became. */
+	for (w = watch->files; w; w = w->next)
+		if (w->type == MD5_JOB_MODEL && w->ready)
+			md5watch_swap_model(watch, w);
+	for (w = watch->files; w; w = w->next)
+		if (w->type == MD5_JOB_ANIM && w->ready
+				&& !(w->parent && w->parent->ready))
+			md5watch_swap_anim(watch, w);
+
+	for (w = watch->files; w; w = w->next)
+		if (w->type == MD5_JOB_MODEL) md5watch_submit(watch, w);
+	for (w = watch->files; w; w = w->next)
+		if (w->type == MD5_JOB_ANIM) md5watch_submit(watch, w);
+	return (int)(watch->stats.swaps - swaps);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static int md5watch_add(struct md5watch *watch, struct md5watched *w,
+		const char *fname) {
+	char *slash;
+
+	w->fname = malloc(strlen(fname) + 1);
+	assert(w->fname);
+	strcpy(w->fname, fname);
+
+	/* the directory, so files replaced by a rename are still seen. */
+	if ((slash = strrchr(w->fname, '/'))) {
+		*slash = '\0';
+		w->wd = inotify_add_watch(watch->fd, slash == w->fname ? "/"
+				: w->fname, MD5_WATCH_EVENTS);
+		*slash = '/';
+		w->base = slash + 1;
+	} else {
+		w->wd = inotify_add_watch(watch->fd, ".", MD5_WATCH_EVENTS);
+		w->base = w->fname;
+	}
+	if (w->wd < 0) {
+		free(w->fname);
+		return 1;
+	}
+
+	w->swapped = NULL;
+	w->udata = NULL;
+	w->err = 0;
+	w->dirty = w->busy = w->ready = 0;
+	w->next = watch->files;
+	watch->files = w;
+	return 0;
+}
+
+/* flags the files named by whatever events are queued. several writes
+ * before the next poll make a single reload. */
+static void md5watch_events(struct md5watch *watch) {
+	union {
+		struct inotify_event ev;
+		char raw[4096];
+	} buf;
+	struct md5watched *w;
+	ssize_t len, at;
+
+	while ((len = read(watch->fd, buf.raw, sizeof(buf))) > 0) {
+		for (at=0; at<len; ) {
+			const struct inotify_event *ev
+				= (const struct inotify_event *)(buf.raw + at);
+
+			at += sizeof(struct inotify_event) + ev->len;
+			watch->stats.events++;
+			for (w = watch->files; w; w = w->next) {
+				/* lost events, anything may have changed. */
+				if (ev->mask & IN_Q_OVERFLOW)
+					w->dirty = 1;
+				else if (ev->len && ev->wd == w->wd
+						&& !strcmp(ev->name, w->base))
+					w->dirty = 1;
+			}
+		}
+	}
+}
+
+/* a clip whose model is reloading too waits for it and is parsed against
+ * the new one. a file changed again while it reloads goes once that is
+ * settled. */
+static void md5watch_submit(struct md5watch *watch, struct md5watched *w) {
+	struct md5watched *p = w->parent;
+
+	if (!w->dirty || w->busy || w->ready) return;
+	if (w->type == MD5_JOB_MODEL) {
+		md5job_model(&w->job, w->fname, &w->next_model);
+	} else if (p && (p->busy || p->ready)) {
+		md5job_anim(&w->job, w->fname, &w->next_anim, &p->next_model,
+				p->busy ? &p->job : NULL);
+	} else {
+		md5job_anim(&w->job, w->fname, &w->next_anim, w->model, NULL);
+	}
+	md5async_submit(watch->pool, &w->job, MD5_PRIO_LOW);
+	w->dirty = 0;
+	w->busy = 1;
+}
+
+/* takes a finished reload off the pool, never waiting for one. */
+static void md5watch_collect(struct md5watch *watch, struct md5watched *w) {
+	int state;
+
+	if (!w->busy) return;
+	if ((state = md5async_state(watch->pool, &w->job)) < MD5_JOB_DONE)
+		return;
+	/* dispatches it here unless someone polling the pool already did. */
+	if (state == MD5_JOB_DONE)
+		md5async_wait(watch->pool, &w->job);
+	w->busy = 0;
+	w->ready = 1;
+	w->err = w->job.err;
+	watch->stats.reloads++;
+}
+
+/* held back while any of its clips is reloading, rejected if any of them,
+ * reloaded or not, no longer matches. */
+static void md5watch_swap_model(struct md5watch *watch,
+		struct md5watched *w) {
+	struct md5watched *a;
+	struct md5model old;
+
+	if (!w->err) {
+		for (a = watch->files; a; a = a->next)
+			if (a->parent == w && a->busy) return;
+		for (a = watch->files; a; a = a->next) {
+			if (a->parent != w) continue;
+			if (!md5anim_matches(a->ready && !a->err ? &a->next_anim : a->anim,
+						&w->next_model)) {
+				md5model_end(&w->next_model);
+				w->err = MD5_WATCH_MISMATCH;
+				watch->stats.rejected++;
+				break;
+			}
+		}
+	}
+	if (!w->err) {
+		old = *w->model;
+		*w->model = w->next_model;
+		md5model_end(&old);
+		if (watch->cache) md5cache_invalidate(watch->cache, w->model, NULL);
+		watch->stats.swaps++;
+	}
+	md5watch_done(w, w->err);
+}
+
+static void md5watch_swap_anim(struct md5watch *watch, struct md5watched *w) {
+	struct md5anim old;
+
+	if (!w->err && w->model && !md5anim_matches(&w->next_anim, w->model)) {
+		md5anim_end(&w->next_anim);
+		w->err = MD5_WATCH_MISMATCH;
+		watch->stats.rejected++;
+	}
+	if (!w->err) {
+		old = *w->anim;
+		*w->anim = w->next_anim;
+		md5anim_end(&old);
+		if (watch->cache) md5cache_invalidate(watch->cache, NULL, w->anim);
+		watch->stats.swaps++;
+	}
+	md5watch_done(w, w->err);
+}
+
+static void md5watch_done(struct md5watched *w, int err) {
+	w->ready = 0;
+	if (w->swapped) w->swapped(w, err, w->udata);
+}
+
+static void md5watched_drop(struct md5watch *watch, struct md5watched *w) {
+	if (w->busy) {
+		md5async_cancel(watch->pool, &w->job);
+		md5async_wait(watch->pool, &w->job);
+		w->busy = 0;
+		w->ready = w->job.state == MD5_JOB_FINISHED;
+		w->err = w->job.err;
+	}
+	if (w->ready && !w->err) md5watched_discard(w);
+	w->ready = 0;
+	free(w->fname);
+	w->fname = w->base = NULL;
+}
+
+static void md5watched_discard(struct md5watched *w) {
+	if (w->type == MD5_JOB_MODEL) md5model_end(&w->next_model);
+	else md5anim_end(&w->next_anim);
+}
@@ -0,0 +1,56 @@
+#ifndef MD5WATCH_H
+#define MD5WATCH_H
+
+#include "md5async.h"
+#include "md5cache.h"
+
+/* a reload was parsed but does not fit the clips or model it goes with. */
+#define MD5_WATCH_MISMATCH (-200)
+
+struct md5watched;
+typedef void (*md5watch_fn)(struct md5watched *, int err, void *udata);
+
+/* a file reloaded in place whenever it is written, owned by the caller.
+ * model or anim is only ever replaced whole, inside md5watch_poll, and
+ * swapped (set it once the file is watched) is called after every attempt
+ * with 0 or the error that kept the old one. binds to a swapped clip or
+ * model must be made again. */
+struct md5watched {
+	int type;                     /* MD5_JOB_MODEL or MD5_JOB_ANIM. */
+	char *fname, *base;
+	struct md5model *model;       /* anims: what they must match, if any. */
+	struct md5anim *anim;
+	struct md5watched *parent;    /* anims: the watched model they belong to. */
+
+	md5watch_fn swapped;
+	void *udata;
+	int err;                      /* of the last reload. */
+
+	int wd, dirty, busy, ready;
+	struct md5job job;
+	struct md5model next_model;
+	struct md5anim next_anim;
+	struct md5watched *next;
+};
+
+/* inotify on the directories of the watched files, catching both editors
+ * that write in place and those that rename a new file over the old. a
+ * cache (set it after md5watch_init) forgets what it skinned from a model
+ * or clip when that is swapped. */
+struct md5watch {
+	int fd;
+	struct md5async *pool;
+	struct md5cache *cache;
+	struct md5watched *files;
+	struct { long events, reloads, swaps, rejected; } stats;
+};
+
+int  md5watch_init(struct md5watch *, struct md5async *pool);
+void md5watch_end(struct md5watch *);
+int  md5watch_model(struct md5watch *, struct md5watched *, const char *fname,
+		struct md5model *);
+int  md5watch_anim(struct md5watch *, struct md5watched *, const char *fname,
+		struct md5anim *, struct md5model *, struct md5watched *parent);
+int  md5watch_poll(struct md5watch *);
+
+#endif /* MD5WATCH_H */